@@ -92,6 +92,25 @@ void GSimulation :: init_mass()
   }
 }
 
+// Ghost particles fill the arrays up to a multiple of the tile: they have
+// no mass, so they do not change the forces, and they are never moved
+void GSimulation :: init_ghosts()
+{
+  for(int i=get_npart(); i<get_npad(); ++i)
+  {
+    particles->pos_x[i] = 0.f;
+    particles->pos_y[i] = 0.f;
+    particles->pos_z[i] = 0.f;
+    particles->vel_x[i] = 0.f;
+    particles->vel_y[i] = 0.f;
+    particles->vel_z[i] = 0.f;
+    particles->acc_x[i] = 0.f;
+    particles->acc_y[i] = 0.f;
+    particles->acc_z[i] = 0.f;
+    particles->mass[i]  = 0.f;
+  }
+}
+
 void GSimulation :: start() 
 {
   real_type energy;
@@ -100,23 +119,30 @@ void GSimulation :: start()
   int i,j;
   
   const int alignment = 64;
+  const int tileSize = 8;
+  
+  // pad the arrays to a multiple of the tile with ghost particles
+  set_npad((n + tileSize - 1) / tileSize * tileSize);
+  const int np = get_npad();
+  
   particles = (ParticleSoA*) _mm_malloc(sizeof(ParticleSoA),alignment);
 
-  particles->pos_x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->pos_y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->pos_z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->vel_x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->vel_y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->vel_z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->acc_x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->acc_y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->acc_z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->mass  = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  particles->pos_x = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->pos_y = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->pos_z = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->vel_x = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->vel_y = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->vel_z = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->acc_x = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->acc_y = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->acc_z = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+  particles->mass  = (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
   
   init_pos();	
   init_vel();
   init_acc();
   init_mass();
+  init_ghosts();
   
   print_header();
   
@@ -133,13 +159,11 @@ void GSimulation :: start()
   double av=0.0, dev=0.0;
   int nf = 0;
   
-  const int tileSize = 8;
-
   const double t0 = time.start();
   for (int s=1; s<=get_nsteps(); ++s)
   {   
    ts0 += time.start(); 
-   for (int ii = 0; ii < n; ii += tileSize )
+   for (int ii = 0; ii < np; ii += tileSize )
    {
      real_type acc_xtile[tileSize];
      real_type acc_ytile[tileSize] ;
@@ -159,11 +183,8 @@ void GSimulation :: start()
      __assume_aligned(particles->acc_z, alignment);
      __assume_aligned(particles->mass, alignment);
      
-     real_type ax_i = particles->acc_x[i];
-     real_type ay_i = particles->acc_y[i];
-     real_type az_i = particles->acc_z[i];
 #pragma omp simd
-     for (j = 0; j < n; j++)
+     for (j = 0; j < np; j++)
      {
       for (int i = ii; i < ii + tileSize; i++)
        {
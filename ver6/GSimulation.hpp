@@ -48,6 +48,7 @@ private:
   ParticleSoA *particles;
   
   int       _npart;		//number of particles
+  int       _npad;		//number of particles with the zero mass ghosts
   int	    _nsteps;		//number of integration steps
   real_type _tstep;		//time step of the simulation
 
@@ -62,10 +63,14 @@ private:
   void init_vel();
   void init_acc();
   void init_mass();
+  void init_ghosts();
     
   inline void set_npart(const int &N){ _npart = N; }
   inline int get_npart() const {return _npart; }
   
+  inline void set_npad(const int &N){ _npad = N; }
+  inline int get_npad() const {return _npad; }
+  
   inline void set_tstep(const real_type &dt){ _tstep = dt; }
   inline real_type get_tstep() const {return _tstep; }
   
@@ -0,0 +1,125 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "Arena.hpp"
+
+static const size_t line = 64;
+static const size_t huge_page = 2 << 20;
+
+Arena :: Arena() : _map(NULL), _mapsize(0), _base(NULL), _size(0), _stride(0),
+                   _nfields(0), _next(0), _hugetlb(false)
+{
+}
+
+Arena :: ~Arena()
+{
+  if(_map != NULL)
+    munmap(_map, _mapsize);
+}
+
+void Arena :: reserve(size_t bytes, int nfields, bool hugetlb)
+{
+  // whole 4 KB pages per field plus one line, so that field k starts k
+  // lines into its page
+  _stride = (bytes + 4095) / 4096 * 4096 + line;
+  _nfields = nfields;
+  _next = 0;
+  _size = _stride * nfields;
+  const size_t rounded = (_size + huge_page - 1) / huge_page * huge_page;
+
+  _hugetlb = false;
+  void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if(hugetlb)
+  {
+    p = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    _hugetlb = (p != MAP_FAILED);
+  }
+#endif
+  if(p != MAP_FAILED)
+  {
+    _map = (char*) p;
+    _mapsize = rounded;
+    _base = _map;
+    return;
+  }
+
+  // one huge page more, to align the start for the transparent huge pages
+  _mapsize = rounded + huge_page;
+  p = mmap(NULL, _mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED)
+  {
+    _map = NULL;
+    _mapsize = 0;
+    _base = NULL;
+    return;
+  }
+  _map = (char*) p;
+  _base = (char*) (((uintptr_t) _map + huge_page - 1) / huge_page * huge_page);
+#ifdef MADV_HUGEPAGE
+  madvise(_base, rounded, MADV_HUGEPAGE);
+#endif
+}
+
+void *Arena :: field()
+{
+  if(_base == NULL || _next >= _nfields) return NULL;
+  return _base + _stride * _next++;
+}
+
+size_t Arena :: page_size(size_t &huge) const
+{
+  huge = 0;
+  size_t page = 4096;
+  std::ifstream smaps("/proc/self/smaps");
+  std::string s;
+  bool inside = false;
+  while(std::getline(smaps, s))
+  {
+    // a mapping starts with its address range "start-end"
+    unsigned long long start, end;
+    char dash;
+    std::istringstream head(s);
+    if((head >> std::hex >> start >> dash >> end) && dash == '-')
+    {
+      inside = (uintptr_t) _base >= start && (uintptr_t) _base < end;
+      continue;
+    }
+    if(!inside) continue;
+    std::istringstream field(s);
+    std::string name;
+    size_t kb = 0;
+    field >> name >> kb;
+    if(name == "KernelPageSize:")
+      page = kb * 1024;
+    else if(name == "AnonHugePages:")
+      huge = kb * 1024;
+  }
+  // the transparent huge pages keep the base page size of the mapping
+  return (page == 4096 && huge > 0) ? huge_page : page;
+}
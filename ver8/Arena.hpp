@@ -0,0 +1,74 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _ARENA_HPP
+#define _ARENA_HPP
+
+#include <stddef.h>
+
+// One mapping for all the particle arrays, on huge pages if possible, so
+// that the j stream of the large runs needs few TLB entries. The fields
+// are cache line aligned and staggered by one cache line modulo 4 KB, so
+// that the same element of different fields does not map to the same L1
+// set. The pages come from the hugetlb pool (MAP_HUGETLB) if asked and
+// available, otherwise transparent huge pages are requested with madvise.
+class Arena
+{
+public:
+  Arena();
+  ~Arena();
+
+  // Map room for nfields fields of bytes each
+  void reserve(size_t bytes, int nfields, bool hugetlb);
+
+  // The next field, NULL once all are taken
+  void *field();
+
+  // Page size obtained for the mapping in bytes, and in huge the bytes on
+  // transparent huge pages, from /proc/self/smaps: meaningful once the
+  // fields have been touched
+  size_t page_size(size_t &huge) const;
+
+  // Is p one of the fields?
+  inline bool owns(const void *p) const
+  {
+    return _base != NULL && (const char*) p >= _base && (const char*) p < _base + _size;
+  }
+
+  inline bool get_hugetlb() const {return _hugetlb; }
+  inline size_t get_size() const {return _size; }
+  inline int get_nfields() const {return _nfields; }
+
+private:
+  char  *_map;			//start of the mapping
+  size_t _mapsize;		//size of the mapping
+  char  *_base;			//first field, 2 MB aligned
+  size_t _size;			//bytes of all the fields
+  size_t _stride;		//distance between two fields
+  int    _nfields;
+  int    _next;			//next free field
+  bool   _hugetlb;		//pages from the hugetlb pool
+
+  Arena(const Arena &);
+  Arena &operator=(const Arena &);
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <mm_malloc.h>
+
+#include "BarnesHut.hpp"
+
+static const int alignment = 32;
+
+BarnesHut :: BarnesHut(real_type theta) : _tree(16), _theta(theta),
+                                          _capacity(0), _ax(NULL), _ay(NULL), _az(NULL)
+{
+}
+
+BarnesHut :: ~BarnesHut()
+{
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+}
+
+void BarnesHut :: reserve(int n)
+{
+  if(n <= _capacity) return;
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+  _ax = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _ay = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _az = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _capacity = n;
+}
+
+double BarnesHut :: compute_forces(ParticleSoA *particles, int n,
+                                   real_type G, real_type softeningSquared)
+{
+  reserve(n);
+  _tree.build(particles, n);
+
+  const std::vector<OctreeNode> &nodes = _tree._nodes;
+  const real_type *x = _tree.x;
+  const real_type *y = _tree.y;
+  const real_type *z = _tree.z;
+  const real_type *m = _tree.m;
+  const real_type theta2 = _theta * _theta;
+  const int nleaves = _tree.get_nleaves();
+
+  double ninter = 0.;
+#pragma omp parallel reduction(+:ninter)
+  {
+    // interaction list of the current leaf: cells enter as pseudo-particles
+    std::vector<real_type> lx, ly, lz, lm;
+    std::vector<int> stack;
+
+#pragma omp for schedule(dynamic,4)
+    for (int l = 0; l < nleaves; ++l)
+    {
+      const OctreeNode &leaf = nodes[_tree._leaves[l]];
+      lx.clear(); ly.clear(); lz.clear(); lm.clear();
+
+      stack.clear();
+      stack.push_back(0);
+      while(!stack.empty())
+      {
+        const OctreeNode &cell = nodes[stack.back()];
+        stack.pop_back();
+
+        // distance between the centre of mass and the leaf cube
+        real_type dx = std::max(std::abs(cell.mx - leaf.cx) - leaf.half, 0.0f);
+        real_type dy = std::max(std::abs(cell.my - leaf.cy) - leaf.half, 0.0f);
+        real_type dz = std::max(std::abs(cell.mz - leaf.cz) - leaf.half, 0.0f);
+        real_type d2 = dx*dx + dy*dy + dz*dz;
+        real_type s  = 2.0f * cell.half;
+
+        if(s*s < theta2 * d2)
+        {
+          lx.push_back(cell.mx); ly.push_back(cell.my); lz.push_back(cell.mz);
+          lm.push_back(cell.mass);
+        }
+        else if(cell.child < 0)
+        {
+          lx.insert(lx.end(), x + cell.begin, x + cell.end);
+          ly.insert(ly.end(), y + cell.begin, y + cell.end);
+          lz.insert(lz.end(), z + cell.begin, z + cell.end);
+          lm.insert(lm.end(), m + cell.begin, m + cell.end);
+        }
+        else
+        {
+          for (int c = cell.child; c < cell.child + cell.nchild; ++c)
+            stack.push_back(c);
+        }
+      }
+
+      const int nlist = (int) lx.size();
+      const real_type *jx = lx.data();
+      const real_type *jy = ly.data();
+      const real_type *jz = lz.data();
+      const real_type *jm = lm.data();
+      for (int i = leaf.begin; i < leaf.end; ++i)
+      {
+        const real_type xi = x[i], yi = y[i], zi = z[i];
+        real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+#pragma omp simd reduction(+:ax_i,ay_i,az_i)
+        for (int j = 0; j < nlist; ++j)
+        {
+          real_type dx = jx[j] - xi;
+          real_type dy = jy[j] - yi;
+          real_type dz = jz[j] - zi;
+
+          real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;
+          real_type distanceInv = 1.0f / sqrtf(distanceSqr);
+
+          real_type f = G * jm[j] * distanceInv * distanceInv * distanceInv;
+          ax_i += dx * f;
+          ay_i += dy * f;
+          az_i += dz * f;
+        }
+        _ax[i] = ax_i;
+        _ay[i] = ay_i;
+        _az[i] = az_i;
+      }
+      ninter += double(leaf.end - leaf.begin) * double(nlist);
+    }
+  }
+
+  _tree.scatter_acc(particles, _ax, _ay, _az);
+  return ninter;
+}
@@ -0,0 +1,53 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BARNESHUT_HPP
+#define _BARNESHUT_HPP
+
+#include "Octree.hpp"
+
+// Barnes-Hut tree code: the octree is rebuilt every step and walked once
+// per leaf (group walk), so that all the particles of a leaf share the
+// same interaction list and the inner loop vectorizes like the direct sum.
+class BarnesHut
+{
+public:
+  BarnesHut(real_type theta = 0.5f);
+  ~BarnesHut();
+
+  // Compute the accelerations of all particles, return the number of
+  // particle-particle and particle-cell interactions evaluated
+  double compute_forces(ParticleSoA *particles, int n,
+                        real_type G, real_type softeningSquared);
+
+  inline void set_theta(const real_type &theta){ _theta = theta; }
+  inline real_type get_theta() const {return _theta; }
+
+private:
+  Octree _tree;
+  real_type _theta;		//opening angle
+
+  int _capacity;
+  real_type *_ax, *_ay, *_az;	//accelerations in tree order
+
+  void reserve(int n);
+};
+
+#endif
@@ -0,0 +1,208 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <mm_malloc.h>
+
+#include "CellList.hpp"
+
+static const int alignment = 32;
+
+CellList :: CellList(real_type rc) : _n(0), x(NULL), y(NULL), z(NULL), m(NULL), index(NULL),
+                                     _nx(0), _ny(0), _nz(0), _rc(rc), _capacity(0),
+                                     _ax(NULL), _ay(NULL), _az(NULL)
+{
+}
+
+CellList :: ~CellList()
+{
+  _mm_free(x);
+  _mm_free(y);
+  _mm_free(z);
+  _mm_free(m);
+  _mm_free(index);
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+}
+
+void CellList :: reserve(int n)
+{
+  if(n <= _capacity) return;
+  _mm_free(x);
+  _mm_free(y);
+  _mm_free(z);
+  _mm_free(m);
+  _mm_free(index);
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+  x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  m = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  index = (int*) _mm_malloc(n*sizeof(int),alignment);
+  _ax = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _ay = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _az = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _capacity = n;
+}
+
+void CellList :: build(const ParticleSoA *particles, int n)
+{
+  _n = n;
+  reserve(n);
+
+  real_type xmin = particles->pos_x[0], xmax = xmin;
+  real_type ymin = particles->pos_y[0], ymax = ymin;
+  real_type zmin = particles->pos_z[0], zmax = zmin;
+#pragma omp parallel for reduction(min:xmin,ymin,zmin) reduction(max:xmax,ymax,zmax)
+  for (int i = 0; i < n; ++i)
+  {
+    xmin = std::min(xmin, particles->pos_x[i]); xmax = std::max(xmax, particles->pos_x[i]);
+    ymin = std::min(ymin, particles->pos_y[i]); ymax = std::max(ymax, particles->pos_y[i]);
+    zmin = std::min(zmin, particles->pos_z[i]); zmax = std::max(zmax, particles->pos_z[i]);
+  }
+
+  // cells of side rc, larger if the particles spread so much that there
+  // would be more cells than particles
+  const double lx = xmax - xmin, ly = ymax - ymin, lz = zmax - zmin;
+  double side = _rc;
+  if(lx * ly * lz > (double) n * side * side * side)
+    side = std::cbrt(lx * ly * lz / n);
+  _nx = std::max(1, (int) (lx / side));
+  _ny = std::max(1, (int) (ly / side));
+  _nz = std::max(1, (int) (lz / side));
+  // the cells may be stretched to fill the box, never shrunk below rc
+  const real_type sx = _nx / (lx * 1.0001 + 1.e-6);
+  const real_type sy = _ny / (ly * 1.0001 + 1.e-6);
+  const real_type sz = _nz / (lz * 1.0001 + 1.e-6);
+
+  const int ncells = get_ncells();
+  _cell.resize(n);
+  _start.assign(ncells + 1, 0);
+
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    const int cx = (int) ((particles->pos_x[i] - xmin) * sx);
+    const int cy = (int) ((particles->pos_y[i] - ymin) * sy);
+    const int cz = (int) ((particles->pos_z[i] - zmin) * sz);
+    _cell[i] = (cz * _ny + cy) * _nx + cx;
+  }
+
+  // counting sort: the particles keep their order within a cell
+  for (int i = 0; i < n; ++i)
+    _start[_cell[i] + 1]++;
+  for (int c = 0; c < ncells; ++c)
+    _start[c + 1] += _start[c];
+  std::vector<int> next(_start.begin(), _start.end() - 1);
+  for (int i = 0; i < n; ++i)
+    index[next[_cell[i]]++] = i;
+
+#pragma omp parallel for
+  for (int k = 0; k < n; ++k)
+  {
+    const int i = index[k];
+    x[k] = particles->pos_x[i];
+    y[k] = particles->pos_y[i];
+    z[k] = particles->pos_z[i];
+    m[k] = particles->mass[i];
+  }
+}
+
+int CellList :: neighbour_rows(int c, int *begin, int *end) const
+{
+  const int cx = c % _nx;
+  const int cy = (c / _nx) % _ny;
+  const int cz = c / (_nx * _ny);
+  const int cx0 = std::max(cx - 1, 0), cx1 = std::min(cx + 1, _nx - 1);
+
+  int nrows = 0;
+  for (int nz = std::max(cz - 1, 0); nz <= std::min(cz + 1, _nz - 1); ++nz)
+    for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, _ny - 1); ++ny)
+    {
+      begin[nrows] = _start[(nz * _ny + ny) * _nx + cx0];
+      end[nrows] = _start[(nz * _ny + ny) * _nx + cx1 + 1];
+      nrows++;
+    }
+  return nrows;
+}
+
+double CellList :: compute_forces(ParticleSoA *particles, int n,
+                                  real_type G, real_type softeningSquared)
+{
+  build(particles, n);
+
+  const real_type rc2 = _rc * _rc;
+  const int ncells = get_ncells();
+
+  double ninter = 0.;
+#pragma omp parallel for schedule(dynamic,16) reduction(+:ninter)
+  for (int c = 0; c < ncells; ++c)
+  {
+    if(_start[c] == _start[c + 1]) continue;
+    int begin[9], end[9];
+    const int nrows = neighbour_rows(c, begin, end);
+    int nlist = 0;
+    for (int r = 0; r < nrows; ++r)
+      nlist += end[r] - begin[r];
+
+    for (int i = _start[c]; i < _start[c + 1]; ++i)
+    {
+      const real_type xi = x[i], yi = y[i], zi = z[i];
+      real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+      for (int r = 0; r < nrows; ++r)
+      {
+#pragma omp simd reduction(+:ax_i,ay_i,az_i)
+        for (int j = begin[r]; j < end[r]; ++j)
+        {
+          real_type dx = x[j] - xi;
+          real_type dy = y[j] - yi;
+          real_type dz = z[j] - zi;
+
+          real_type r2 = dx*dx + dy*dy + dz*dz;
+          real_type distanceInv = 1.0f / sqrtf(r2 + softeningSquared);
+
+          real_type f = (r2 < rc2) ? G * m[j] * distanceInv * distanceInv * distanceInv : 0.0f;
+          ax_i += dx * f;
+          ay_i += dy * f;
+          az_i += dz * f;
+        }
+      }
+      _ax[i] = ax_i;
+      _ay[i] = ay_i;
+      _az[i] = az_i;
+    }
+    ninter += double(_start[c + 1] - _start[c]) * double(nlist);
+  }
+
+#pragma omp parallel for
+  for (int k = 0; k < n; ++k)
+  {
+    const int i = index[k];
+    particles->acc_x[i] = _ax[k];
+    particles->acc_y[i] = _ay[k];
+    particles->acc_z[i] = _az[k];
+  }
+  return ninter;
+}
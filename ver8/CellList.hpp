@@ -0,0 +1,73 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _CELLLIST_HPP
+#define _CELLLIST_HPP
+
+#include <vector>
+
+#include "Particle.hpp"
+
+// Linked cells for a force cut off at rc: the particles are binned into a
+// uniform grid of cells of side at least rc over their bounding box, and
+// copies are sorted by cell with x the fastest index. The three neighbour
+// cells along x are then one contiguous range, and the 27 neighbour cells
+// of a cell are 9 ranges that the inner loop streams with SIMD, masking
+// the pairs farther than rc.
+class CellList
+{
+public:
+  CellList(real_type rc = 0.1f);
+  ~CellList();
+
+  // Bin and sort the particles by cell
+  void build(const ParticleSoA *particles, int n);
+
+  // Bin the particles and compute the accelerations from the neighbours
+  // closer than rc, return the number of pair interactions evaluated
+  double compute_forces(ParticleSoA *particles, int n,
+                        real_type G, real_type softeningSquared);
+
+  inline real_type get_cutoff() const {return _rc; }
+  inline int get_ncells() const {return _nx * _ny * _nz; }
+
+  // The ranges [begin,end) of sorted particles of the 27 neighbour cells of
+  // the cell c, in at most 9 rows; return the number of rows
+  int neighbour_rows(int c, int *begin, int *end) const;
+
+  // particle copies sorted by cell
+  int _n;
+  real_type *x, *y, *z, *m;
+  int *index;				//original index of each sorted particle
+
+  int _nx, _ny, _nz;			//cells per dimension
+  std::vector<int> _start;		//first sorted particle of every cell, and n
+
+private:
+  real_type _rc;		//cutoff radius
+  int _capacity;
+  std::vector<int> _cell;	//cell of every particle
+  real_type *_ax, *_ay, *_az;	//accelerations in sorted order
+
+  void reserve(int n);
+};
+
+#endif
@@ -0,0 +1,193 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <omp.h>
+
+#include "Ewald.hpp"
+
+static const int ntable = 4096;		//intervals of the real space table
+
+Ewald :: Ewald(real_type alpha, int kmax) : _alpha(alpha), _kmax(kmax)
+{
+  // h(r) on a uniform grid in r^2 up to the largest minimum image distance,
+  // with a guard entry for the interpolation at the end; h(0) is the limit
+  // 4 alpha^3 / 3 sqrt(pi)
+  _scale = ntable / 0.75f;
+  _table.resize(ntable + 2);
+  _table[0] = 4. * alpha * alpha * alpha / (3. * sqrt(M_PI));
+  for (int i = 1; i < ntable + 2; ++i)
+  {
+    const double r = sqrt(i / (double) _scale);
+    _table[i] = (erf(alpha * r) - 2. * alpha * r / sqrt(M_PI) * exp(-alpha * alpha * r * r))
+              / (r * r * r);
+  }
+
+  for (int mx = 0; mx <= kmax; ++mx)
+    for (int my = -kmax; my <= kmax; ++my)
+      for (int mz = -kmax; mz <= kmax; ++mz)
+      {
+        const int m2 = mx*mx + my*my + mz*mz;
+        if(m2 == 0 || m2 > kmax*kmax) continue;
+        if(mx == 0 && (my < 0 || (my == 0 && mz < 0))) continue;
+        const double k2 = 4. * M_PI * M_PI * m2;
+        _mx.push_back(mx);
+        _my.push_back(my);
+        _mz.push_back(mz);
+        _coef.push_back(-16. * M_PI * M_PI * exp(-k2 / (4. * alpha * alpha)) / k2);
+      }
+  _ck.resize(_mx.size());
+  _sk.resize(_mx.size());
+}
+
+double Ewald :: compute_forces(ParticleSoA *particles, int n, int nj, const KernelTable *kernels,
+                               real_type G, real_type softeningSquared)
+{
+  const int np = std::max(n, nj);
+  const int nm = _kmax + 1;
+  double ninter = kernels->ewald_real(particles, n, nj, G, softeningSquared,
+                                      &_table[0], _scale);
+  phases(particles, np);
+  ninter += kernels->ewald_fourier(&_ec[0], &_es[0], np, nm, particles->mass, n, nj,
+                                   &_mx[0], &_my[0], &_mz[0], &_coef[0], get_nk(), G,
+                                   &_ck[0], &_sk[0],
+                                   particles->acc_x, particles->acc_y, particles->acc_z);
+  return ninter;
+}
+
+// The phases of the Fourier part, exp(i k.x), are products of the
+// per-dimension tables of cos and sin of 2 pi m x, built by recurrence
+void Ewald :: phases(const ParticleSoA *particles, int np)
+{
+  const int nm = _kmax + 1;
+  _ec.resize(3 * nm * (size_t) np);
+  _es.resize(3 * nm * (size_t) np);
+  const real_type *pos[3] = { particles->pos_x, particles->pos_y, particles->pos_z };
+  real_type *ec = &_ec[0];
+  real_type *es = &_es[0];
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < np; ++i)
+    for (int d = 0; d < 3; ++d)
+    {
+      const real_type c1 = cosf(2.0f * (real_type) M_PI * pos[d][i]);
+      const real_type s1 = sinf(2.0f * (real_type) M_PI * pos[d][i]);
+      real_type c = 1.0f, s = 0.0f;
+      for (int m = 0; m < nm; ++m)
+      {
+        ec[(d * nm + m) * (size_t) np + i] = c;
+        es[(d * nm + m) * (size_t) np + i] = s;
+        const real_type t = c * c1 - s * s1;
+        s = s * c1 + c * s1;
+        c = t;
+      }
+    }
+}
+
+void Ewald :: reference(const real_type *x, const real_type *y, const real_type *z,
+                        const real_type *m, int n, real_type G, real_type softeningSquared,
+                        int stride, std::vector<double> &acc)
+{
+  // erfc(alpha) is below 1e-8 at the distance of the 28th image, and
+  // exp(-pi^2 m^2/alpha^2) at |m| = 6
+  const double alpha = 4.;
+  const int kmax = 6;
+  const int ns = (n + stride - 1) / stride;
+  acc.assign(3 * ns, 0.);
+
+  std::vector<double> kv, ck, sk;
+  for (int mx = 0; mx <= kmax; ++mx)
+    for (int my = -kmax; my <= kmax; ++my)
+      for (int mz = -kmax; mz <= kmax; ++mz)
+      {
+        const int m2 = mx*mx + my*my + mz*mz;
+        if(m2 == 0 || m2 > kmax*kmax) continue;
+        if(mx == 0 && (my < 0 || (my == 0 && mz < 0))) continue;
+        kv.push_back(2. * M_PI * mx);
+        kv.push_back(2. * M_PI * my);
+        kv.push_back(2. * M_PI * mz);
+      }
+  const int nk = kv.size() / 3;
+  ck.assign(nk, 0.);
+  sk.assign(nk, 0.);
+
+#pragma omp parallel for schedule(static)
+  for (int k = 0; k < nk; ++k)
+  {
+    const double k2 = kv[3*k]*kv[3*k] + kv[3*k+1]*kv[3*k+1] + kv[3*k+2]*kv[3*k+2];
+    const double coef = -8. * M_PI * G * exp(-k2 / (4. * alpha * alpha)) / k2;
+    for (int j = 0; j < n; ++j)
+    {
+      const double phase = kv[3*k] * x[j] + kv[3*k+1] * y[j] + kv[3*k+2] * z[j];
+      ck[k] += coef * m[j] * cos(phase);
+      sk[k] += coef * m[j] * sin(phase);
+    }
+  }
+
+#pragma omp parallel for schedule(dynamic)
+  for (int s = 0; s < ns; ++s)
+  {
+    const int i = s * stride;
+    double ax = 0., ay = 0., az = 0.;
+    for (int j = 0; j < n; ++j)
+    {
+      if(j == i) continue;
+      double dx = x[j] - x[i];
+      double dy = y[j] - y[i];
+      double dz = z[j] - z[i];
+      dx -= rint(dx);
+      dy -= rint(dy);
+      dz -= rint(dz);
+      // the softening of the nearest image
+      double r2 = dx*dx + dy*dy + dz*dz;
+      double distanceInv = 1. / sqrt(r2 + softeningSquared);
+      double f = G * m[j] * (distanceInv * distanceInv * distanceInv - 1. / (r2 * sqrt(r2)));
+      ax += dx * f;
+      ay += dy * f;
+      az += dz * f;
+      for (int img = 0; img < 27; ++img)
+      {
+        const double ix = dx + img % 3 - 1;
+        const double iy = dy + img / 3 % 3 - 1;
+        const double iz = dz + img / 9 - 1;
+        r2 = ix*ix + iy*iy + iz*iz;
+        if(r2 > 1.) continue;
+        const double r = sqrt(r2);
+        f = G * m[j] / (r2 * r) * (erfc(alpha * r) + 2. * alpha * r / sqrt(M_PI) * exp(-alpha * alpha * r2));
+        ax += ix * f;
+        ay += iy * f;
+        az += iz * f;
+      }
+    }
+    for (int k = 0; k < nk; ++k)
+    {
+      const double phase = kv[3*k] * x[i] + kv[3*k+1] * y[i] + kv[3*k+2] * z[i];
+      const double f = sin(phase) * ck[k] - cos(phase) * sk[k];
+      ax += kv[3*k] * f;
+      ay += kv[3*k+1] * f;
+      az += kv[3*k+2] * f;
+    }
+    acc[3*s]   = ax;
+    acc[3*s+1] = ay;
+    acc[3*s+2] = az;
+  }
+}
@@ -0,0 +1,78 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _EWALD_HPP
+#define _EWALD_HPP
+
+#include <vector>
+
+#include "Particle.hpp"
+#include "Kernels.hpp"
+
+// Ewald summation in the periodic unit box, with a uniform background
+// cancelling the mean density. The Newtonian pair force is split as
+//   G m r/r^3 g(r),  g(r) = erfc(alpha r) + 2 alpha r/sqrt(pi) exp(-alpha^2 r^2)
+// in real space, summed over the nearest image only (erfc(alpha/2) is
+// negligible for the default alpha), and the rest over the k-vectors
+// k = 2 pi (mx,my,mz), |m| <= kmax, in Fourier space. The real space pair
+// is the softened direct sum minus the correction h(r) = (1 - g(r))/r^3,
+// smooth and tabulated in r^2 once, so that it costs a lookup more than the
+// direct sum and the softening does not depend on alpha.
+class Ewald
+{
+public:
+  Ewald(real_type alpha = 6.0f, int kmax = 7);
+
+  // Compute the accelerations of the n particles from the first nj, return
+  // the number of real space pairs and k-vector terms evaluated
+  double compute_forces(ParticleSoA *particles, int n, int nj, const KernelTable *kernels,
+                        real_type G, real_type softeningSquared);
+
+  // Periodic accelerations of the particles 0, stride, 2 stride, ... in
+  // double precision, with a split independent of the one of the solver:
+  // 27 images in real space; acc gets 3 values per particle
+  static void reference(const real_type *x, const real_type *y, const real_type *z,
+                        const real_type *m, int n, real_type G, real_type softeningSquared,
+                        int stride, std::vector<double> &acc);
+
+  inline real_type get_alpha() const {return _alpha; }
+  inline int get_kmax() const {return _kmax; }
+  inline int get_nk() const {return (int) _mx.size(); }
+
+private:
+  real_type _alpha;		//split parameter, in 1/box length
+  int _kmax;			//largest |m| of the k-vectors
+
+  std::vector<real_type> _table;	//h at r^2 = i / _scale, for r^2 up to 3/4
+  real_type _scale;
+
+  // half of the k-space, k and -k give the same force
+  std::vector<int> _mx, _my, _mz;
+  std::vector<real_type> _coef;		//-16 pi^2 exp(-k^2/4alpha^2)/k^2
+  std::vector<real_type> _ck, _sk;	//structure factors, times G and the coefficient
+
+  // cos and sin of 2 pi m x for m = 0..kmax, per dimension
+  std::vector<real_type> _ec, _es;
+
+  void phases(const ParticleSoA *particles, int np);
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <utility>
+
+#include "FFT.hpp"
+
+FFT3D :: FFT3D(int n) : _n(n), _log2n(0)
+{
+  while((1 << _log2n) < n) ++_log2n;
+
+  _twiddle.resize(n / 2);
+  for (int k = 0; k < n / 2; ++k)
+    _twiddle[k] = std::polar(1.0, -2.0 * M_PI * k / n);
+
+  _reverse.resize(n);
+  for (int k = 0; k < n; ++k)
+  {
+    int r = 0;
+    for (int b = 0; b < _log2n; ++b)
+      if(k & (1 << b)) r |= 1 << (_log2n - 1 - b);
+    _reverse[k] = r;
+  }
+}
+
+void FFT3D :: forward(complex_type *data) const
+{
+  transform(data, false);
+}
+
+void FFT3D :: inverse(complex_type *data) const
+{
+  transform(data, true);
+}
+
+// iterative Cooley-Tukey on one contiguous line of length n
+void FFT3D :: transform_line(complex_type *line, bool inverse) const
+{
+  const int n = _n;
+  for (int k = 0; k < n; ++k)
+    if(k < _reverse[k]) std::swap(line[k], line[_reverse[k]]);
+
+  for (int len = 2; len <= n; len <<= 1)
+  {
+    const int half = len >> 1;
+    const int step = n / len;
+    for (int start = 0; start < n; start += len)
+      for (int k = 0; k < half; ++k)
+      {
+        complex_type w = _twiddle[k * step];
+        if(inverse) w = std::conj(w);
+        const complex_type t = w * line[start + k + half];
+        line[start + k + half] = line[start + k] - t;
+        line[start + k] += t;
+      }
+  }
+}
+
+void FFT3D :: transform(complex_type *data, bool inverse) const
+{
+  const int n = _n;
+  const long n2 = (long) n * n;
+
+  // z lines are contiguous
+#pragma omp parallel for
+  for (long l = 0; l < n2; ++l)
+    transform_line(data + l * n, inverse);
+
+  // y and x lines are gathered into a contiguous buffer
+#pragma omp parallel
+  {
+    std::vector<complex_type> line(n);
+#pragma omp for
+    for (long l = 0; l < n2; ++l)
+    {
+      const long x = l / n, z = l % n;
+      complex_type *base = data + x * n2 + z;
+      for (int y = 0; y < n; ++y) line[y] = base[(long) y * n];
+      transform_line(&line[0], inverse);
+      for (int y = 0; y < n; ++y) base[(long) y * n] = line[y];
+    }
+#pragma omp for
+    for (long l = 0; l < n2; ++l)
+    {
+      complex_type *base = data + l;
+      for (int x = 0; x < n; ++x) line[x] = base[(long) x * n2];
+      transform_line(&line[0], inverse);
+      for (int x = 0; x < n; ++x) base[(long) x * n2] = line[x];
+    }
+  }
+}
@@ -0,0 +1,52 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FFT_HPP
+#define _FFT_HPP
+
+#include <complex>
+#include <vector>
+
+typedef std::complex<double> complex_type;
+
+// Self-contained radix-2 complex FFT on a cubic n x n x n grid stored in
+// row major order (z fastest). The 1D transforms along each axis are
+// distributed over the OpenMP threads. The inverse is not normalized.
+class FFT3D
+{
+public:
+  FFT3D(int n);
+
+  void forward(complex_type *data) const;
+  void inverse(complex_type *data) const;
+
+  inline int get_size() const {return _n; }
+
+private:
+  int _n;
+  int _log2n;
+  std::vector<complex_type> _twiddle;	//exp(-2 pi i k / n), k < n/2
+  std::vector<int> _reverse;		//bit reversal permutation
+
+  void transform(complex_type *data, bool inverse) const;
+  void transform_line(complex_type *line, bool inverse) const;
+};
+
+#endif
@@ -0,0 +1,371 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <mm_malloc.h>
+
+#include "FMM.hpp"
+
+static const int alignment = 32;
+static const int max_task_level = 4;	//spawn OpenMP tasks above this depth
+static const int max_order = 12;
+static const int max_ncoef = (max_order+1)*(max_order+2)*(max_order+3)/6;
+
+static double binomial(int n, int k)
+{
+  double b = 1.;
+  for (int i = 1; i <= k; ++i)
+    b = b * (n - k + i) / i;
+  return b;
+}
+
+FMM :: FMM(int order) : _tree(64), _theta(0.5f), _capacity(0), _ax(NULL), _ay(NULL), _az(NULL)
+{
+  set_order(order);
+}
+
+FMM :: ~FMM()
+{
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+}
+
+void FMM :: reserve(int n)
+{
+  if(n <= _capacity) return;
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+  _ax = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _ay = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _az = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _capacity = n;
+}
+
+void FMM :: set_order(int order)
+{
+  _order = std::min(std::max(order, 1), max_order);
+  const int p = _order;
+
+  // monomials sorted by degree, so that lower degrees come first
+  _kx.clear(); _ky.clear(); _kz.clear();
+  _index.assign((p+1)*(p+1)*(p+1), -1);
+  for (int deg = 0; deg <= p; ++deg)
+    for (int kx = deg; kx >= 0; --kx)
+      for (int ky = deg - kx; ky >= 0; --ky)
+      {
+        const int kz = deg - kx - ky;
+        _index[(kx * (p + 1) + ky) * (p + 1) + kz] = (int) _kx.size();
+        _kx.push_back(kx); _ky.push_back(ky); _kz.push_back(kz);
+      }
+  _ncoef = (int) _kx.size();
+
+  _m2m.clear(); _m2l.clear(); _l2l.clear();
+  for (int k = 0; k < _ncoef; ++k)
+    for (int l = 0; l < _ncoef; ++l)
+    {
+      // M2M and L2L: shift by the difference of the exponents
+      if(_kx[l] <= _kx[k] && _ky[l] <= _ky[k] && _kz[l] <= _kz[k])
+      {
+        const int d = index(_kx[k]-_kx[l], _ky[k]-_ky[l], _kz[k]-_kz[l]);
+        const double c = binomial(_kx[k],_kx[l]) * binomial(_ky[k],_ky[l]) * binomial(_kz[k],_kz[l]);
+        Term mm = {k, l, d, c};
+        Term ll = {l, k, d, c};
+        _m2m.push_back(mm);
+        _l2l.push_back(ll);
+      }
+      // M2L: local coefficient k from multipole coefficient l
+      const int deg = _kx[k] + _ky[k] + _kz[k] + _kx[l] + _ky[l] + _kz[l];
+      if(deg <= p)
+      {
+        const int s = index(_kx[k]+_kx[l], _ky[k]+_ky[l], _kz[k]+_kz[l]);
+        const double sign = ((_kx[l] + _ky[l] + _kz[l]) % 2) ? -1. : 1.;
+        const double c = sign * binomial(_kx[k]+_kx[l],_kx[k]) * binomial(_ky[k]+_ky[l],_ky[k])
+                              * binomial(_kz[k]+_kz[l],_kz[k]);
+        Term ml = {k, l, s, c};
+        _m2l.push_back(ml);
+      }
+    }
+}
+
+// pw[k] = dx^kx dy^ky dz^kz for all monomials
+void FMM :: powers(double dx, double dy, double dz, double *pw) const
+{
+  pw[0] = 1.;
+  for (int k = 1; k < _ncoef; ++k)
+  {
+    if(_kx[k] > 0)      pw[k] = pw[index(_kx[k]-1,_ky[k],_kz[k])] * dx;
+    else if(_ky[k] > 0) pw[k] = pw[index(_kx[k],_ky[k]-1,_kz[k])] * dy;
+    else                pw[k] = pw[index(_kx[k],_ky[k],_kz[k]-1)] * dz;
+  }
+}
+
+// Taylor coefficients a_k = D^k (1/|R|) / k! from the recurrence
+// |k| R^2 a_k + (2|k|-1) sum_i R_i a_{k-e_i} + (|k|-1) sum_i a_{k-2e_i} = 0
+// The recurrence holds as well for the softened 1/sqrt(R^2 + eps^2) once
+// R^2 is replaced by R^2 + eps^2, so the far field is softened like P2P.
+void FMM :: derivatives(double dx, double dy, double dz, double *a) const
+{
+  const double r2 = dx*dx + dy*dy + dz*dz + _softeningSquared;
+  const double r2inv = 1. / r2;
+  a[0] = sqrt(r2inv);
+  for (int k = 1; k < _ncoef; ++k)
+  {
+    const int kx = _kx[k], ky = _ky[k], kz = _kz[k];
+    const int deg = kx + ky + kz;
+    double s1 = 0., s2 = 0.;
+    if(kx > 0) s1 += dx * a[index(kx-1,ky,kz)];
+    if(ky > 0) s1 += dy * a[index(kx,ky-1,kz)];
+    if(kz > 0) s1 += dz * a[index(kx,ky,kz-1)];
+    if(kx > 1) s2 += a[index(kx-2,ky,kz)];
+    if(ky > 1) s2 += a[index(kx,ky-2,kz)];
+    if(kz > 1) s2 += a[index(kx,ky,kz-2)];
+    a[k] = -((2*deg - 1) * s1 + (deg - 1) * s2) * r2inv / deg;
+  }
+}
+
+double FMM :: compute_forces(ParticleSoA *particles, int n,
+                             real_type G, real_type softeningSquared)
+{
+  reserve(n);
+  _tree.build(particles, n);
+  _G = G;
+  _softeningSquared = softeningSquared;
+
+  const int nnodes = _tree.get_nnodes();
+  _M.assign((size_t) nnodes * _ncoef, 0.);
+  _L.assign((size_t) nnodes * _ncoef, 0.);
+  _radius.resize(nnodes);
+  _levels.clear();
+  for (int c = 0; c < nnodes; ++c)
+  {
+    const OctreeNode &cell = _tree._nodes[c];
+    if(cell.level >= (int) _levels.size()) _levels.resize(cell.level + 1);
+    _levels[cell.level].push_back(c);
+    // expansions are centred on the centre of mass
+    double ex = std::abs(cell.mx - cell.cx) + cell.half;
+    double ey = std::abs(cell.my - cell.cy) + cell.half;
+    double ez = std::abs(cell.mz - cell.cz) + cell.half;
+    _radius[c] = sqrt(ex*ex + ey*ey + ez*ez);
+  }
+
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    _ax[i] = 0.0f;
+    _ay[i] = 0.0f;
+    _az[i] = 0.0f;
+  }
+
+  _np2p = 0.;
+  _nm2l = 0.;
+
+  upward();
+#pragma omp parallel
+#pragma omp single
+  interact(0, 0);
+  downward();
+
+  _tree.scatter_acc(particles, _ax, _ay, _az);
+  return _np2p + _nm2l;
+}
+
+// P2M at the leaves and M2M towards the root, one level at a time
+void FMM :: upward()
+{
+  const std::vector<OctreeNode> &nodes = _tree._nodes;
+  const real_type *x = _tree.x, *y = _tree.y, *z = _tree.z, *m = _tree.m;
+
+  for (int l = (int) _levels.size() - 1; l >= 0; --l)
+  {
+    const std::vector<int> &level = _levels[l];
+#pragma omp parallel
+    {
+      std::vector<double> pw(_ncoef);
+#pragma omp for schedule(dynamic,8)
+      for (int c = 0; c < (int) level.size(); ++c)
+      {
+        const OctreeNode &cell = nodes[level[c]];
+        double *M = &_M[(size_t) level[c] * _ncoef];
+        if(cell.child < 0)
+        {
+          for (int j = cell.begin; j < cell.end; ++j)
+          {
+            powers(x[j] - cell.mx, y[j] - cell.my, z[j] - cell.mz, &pw[0]);
+            for (int k = 0; k < _ncoef; ++k)
+              M[k] += m[j] * pw[k];
+          }
+        }
+        else
+        {
+          for (int ch = cell.child; ch < cell.child + cell.nchild; ++ch)
+          {
+            const OctreeNode &child = nodes[ch];
+            const double *Mc = &_M[(size_t) ch * _ncoef];
+            powers(child.mx - cell.mx, child.my - cell.my, child.mz - cell.mz, &pw[0]);
+            for (size_t t = 0; t < _m2m.size(); ++t)
+              M[_m2m[t].out] += _m2m[t].c * pw[_m2m[t].shift] * Mc[_m2m[t].in];
+          }
+        }
+      }
+    }
+  }
+}
+
+// L2L from the root towards the leaves, L2P at the leaves
+void FMM :: downward()
+{
+  const std::vector<OctreeNode> &nodes = _tree._nodes;
+  const real_type *x = _tree.x, *y = _tree.y, *z = _tree.z;
+
+  for (int l = 0; l < (int) _levels.size(); ++l)
+  {
+    const std::vector<int> &level = _levels[l];
+#pragma omp parallel
+    {
+      std::vector<double> pw(_ncoef);
+#pragma omp for schedule(dynamic,8)
+      for (int c = 0; c < (int) level.size(); ++c)
+      {
+        const OctreeNode &cell = nodes[level[c]];
+        const double *L = &_L[(size_t) level[c] * _ncoef];
+        if(cell.child >= 0)
+        {
+          for (int ch = cell.child; ch < cell.child + cell.nchild; ++ch)
+          {
+            const OctreeNode &child = nodes[ch];
+            double *Lc = &_L[(size_t) ch * _ncoef];
+            powers(child.mx - cell.mx, child.my - cell.my, child.mz - cell.mz, &pw[0]);
+            for (size_t t = 0; t < _l2l.size(); ++t)
+              Lc[_l2l[t].out] += _l2l[t].c * pw[_l2l[t].shift] * L[_l2l[t].in];
+          }
+          continue;
+        }
+        // acceleration = G grad(phi), phi(x) = sum_n L_n (x - c)^n
+        for (int i = cell.begin; i < cell.end; ++i)
+        {
+          powers(x[i] - cell.mx, y[i] - cell.my, z[i] - cell.mz, &pw[0]);
+          double gx = 0., gy = 0., gz = 0.;
+          for (int k = 1; k < _ncoef; ++k)
+          {
+            const int kx = _kx[k], ky = _ky[k], kz = _kz[k];
+            if(kx > 0) gx += L[k] * kx * pw[index(kx-1,ky,kz)];
+            if(ky > 0) gy += L[k] * ky * pw[index(kx,ky-1,kz)];
+            if(kz > 0) gz += L[k] * kz * pw[index(kx,ky,kz-1)];
+          }
+          _ax[i] += _G * gx;
+          _ay[i] += _G * gy;
+          _az[i] += _G * gz;
+        }
+      }
+    }
+  }
+}
+
+// Dual tree traversal. Results are only written to the target cell a, so the
+// children of a target can be processed by concurrent tasks.
+void FMM :: interact(int a, int b)
+{
+  const OctreeNode &A = _tree._nodes[a];
+  const OctreeNode &B = _tree._nodes[b];
+
+  const double dx = A.mx - B.mx;
+  const double dy = A.my - B.my;
+  const double dz = A.mz - B.mz;
+  const double r = _radius[a] + _radius[b];
+  if(a != b && r*r < _theta * _theta * (dx*dx + dy*dy + dz*dz))
+  {
+    m2l(a, b);
+    return;
+  }
+  if(A.child < 0 && B.child < 0)
+  {
+    p2p(a, b);
+    return;
+  }
+
+  if(B.child < 0 || (A.child >= 0 && A.half >= B.half))
+  {
+    for (int c = A.child; c < A.child + A.nchild; ++c)
+    {
+#pragma omp task firstprivate(c) if(A.level < max_task_level)
+      interact(c, b);
+    }
+#pragma omp taskwait
+  }
+  else
+  {
+    for (int c = B.child; c < B.child + B.nchild; ++c)
+      interact(a, c);
+  }
+}
+
+void FMM :: m2l(int a, int b)
+{
+  const OctreeNode &A = _tree._nodes[a];
+  const OctreeNode &B = _tree._nodes[b];
+  double deriv[max_ncoef];
+  derivatives(A.mx - B.mx, A.my - B.my, A.mz - B.mz, deriv);
+
+  double *L = &_L[(size_t) a * _ncoef];
+  const double *M = &_M[(size_t) b * _ncoef];
+  for (size_t t = 0; t < _m2l.size(); ++t)
+    L[_m2l[t].out] += _m2l[t].c * deriv[_m2l[t].shift] * M[_m2l[t].in];
+
+#pragma omp atomic
+  _nm2l += 1.;
+}
+
+void FMM :: p2p(int a, int b)
+{
+  const OctreeNode &A = _tree._nodes[a];
+  const OctreeNode &B = _tree._nodes[b];
+  const real_type *x = _tree.x, *y = _tree.y, *z = _tree.z, *m = _tree.m;
+  const real_type G = _G;
+  const real_type softeningSquared = _softeningSquared;
+
+  for (int i = A.begin; i < A.end; ++i)
+  {
+    const real_type xi = x[i], yi = y[i], zi = z[i];
+    real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+#pragma omp simd reduction(+:ax_i,ay_i,az_i)
+    for (int j = B.begin; j < B.end; ++j)
+    {
+      real_type dx = x[j] - xi;
+      real_type dy = y[j] - yi;
+      real_type dz = z[j] - zi;
+
+      real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;
+      real_type distanceInv = 1.0f / sqrtf(distanceSqr);
+
+      real_type f = G * m[j] * distanceInv * distanceInv * distanceInv;
+      ax_i += dx * f;
+      ay_i += dy * f;
+      az_i += dz * f;
+    }
+    _ax[i] += ax_i;
+    _ay[i] += ay_i;
+    _az[i] += az_i;
+  }
+
+#pragma omp atomic
+  _np2p += double(A.end - A.begin) * double(B.end - B.begin);
+}
@@ -0,0 +1,91 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FMM_HPP
+#define _FMM_HPP
+
+#include <vector>
+
+#include "Octree.hpp"
+
+// Fast Multipole Method with Cartesian Taylor expansions of order p.
+// The expansions are stored per octree cell as coefficients of the
+// monomials x^kx y^ky z^kz with kx+ky+kz <= p:
+//   P2M/M2M  M_k = sum_j m_j (x_j - c)^k
+//   M2L      L_n = sum_k (-1)^|k| C(k+n,n) a_{k+n}(c_A - c_B) M_k
+//   L2L/L2P  phi(x) = sum_n L_n (x - c)^n
+// where a_k(R) are the Taylor coefficients of the softened 1/|R|. Cells are
+// paired by a dual tree traversal, near cells interact particle by particle.
+class FMM
+{
+public:
+  FMM(int order = 4);
+  ~FMM();
+
+  // Compute the accelerations of all particles, return the number of
+  // particle-particle and cell-cell interactions evaluated
+  double compute_forces(ParticleSoA *particles, int n,
+                        real_type G, real_type softeningSquared);
+
+  void set_order(int order);
+  inline int get_order() const {return _order; }
+
+private:
+  struct Term
+  {
+    int out, in, shift;		//coefficient indices
+    double c;			//binomial factor (and sign)
+  };
+
+  Octree _tree;
+  int _order;			//expansion order p
+  int _ncoef;			//number of monomials with degree <= p
+  real_type _theta;		//cell-cell acceptance criterion
+
+  std::vector<int> _kx, _ky, _kz;	//exponents of each monomial
+  std::vector<int> _index;		//monomial index of (kx,ky,kz)
+  std::vector<Term> _m2m, _m2l, _l2l;
+
+  std::vector<double> _M, _L;		//expansions, _ncoef per cell
+  std::vector<double> _radius;		//radius of each cell around its centre
+  std::vector< std::vector<int> > _levels;
+
+  real_type _G, _softeningSquared;
+  double _np2p, _nm2l;			//interaction counters
+
+  int _capacity;
+  real_type *_ax, *_ay, *_az;		//accelerations in tree order
+
+  void reserve(int n);
+  inline int index(int kx, int ky, int kz) const
+  {
+    return _index[(kx * (_order + 1) + ky) * (_order + 1) + kz];
+  }
+  void powers(double dx, double dy, double dz, double *pw) const;
+  void derivatives(double dx, double dy, double dz, double *a) const;
+
+  void upward();
+  void downward();
+  void interact(int a, int b);
+  void m2l(int a, int b);
+  void p2p(int a, int b);
+};
+
+#endif
@@ -18,17 +18,95 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include "GSimulation.hpp"
+#include "BarnesHut.hpp"
+#include "FMM.hpp"
+#include "ParticleMesh.hpp"
+#include "TreePM.hpp"
+#include "Respa.hpp"
+#include "CellList.hpp"
+#include "VerletList.hpp"
+#include "Ewald.hpp"
+#include "Arena.hpp"
+#include "Kernels.hpp"
 #include "cpu_time.hpp"
 
+static const int alignment = 32;
+static const int padding = 16;		//widest register tile and vector
+static const double min_block = 1. / (1 << 20);	//smallest block step, in units of dt
+
+static const float softeningSquared = 1.e-3f;
+static const float G = 6.67259e-11f;
+
 GSimulation :: GSimulation()
 {
   std::cout << "===============================" << std::endl;
   std::cout << " Initialize Gravity Simulation" << std::endl;
   set_npart(2000); 
+  set_ntracers(0);
   set_nsteps(500);
   set_tstep(0.1); 
   set_sfreq(50);
+  set_force_mode(FORCE_DIRECT);
+  set_kernel(KERNEL_PRAGMA);
+  set_isa("");
+  set_itile(0);
+  set_jtile(0);
+  set_fused(false);
+  set_lowmem(false);
+  set_packed(false);
+  set_integrator(INTEGRATOR_EULER);
+  set_eta(0.02);
+  set_nsub(4);
+  set_rcut(0.1);
+  set_skin(0.02);
+  _tuned = false;
+  set_theta(0.5);
+  set_order(4);
+  set_ngrid(64);
+  set_rsplit(0.);
+  set_alpha(6.);
+  set_kmax(7);
+  set_layout(false);
+  set_reorder(0);
+  set_curve(CURVE_HILBERT);
+  set_output("");
+  set_pages("");
+  set_check(false);
+  set_adaptive(0.);
+  set_reject(0.);
+  set_tend(0.);
+  particles = NULL;
+  bh = NULL;
+  fmm = NULL;
+  pm = NULL;
+  treepm = NULL;
+  respa = NULL;
+  cells = NULL;
+  verlet = NULL;
+  ewald = NULL;
+  curve = NULL;
+  _arena = NULL;
+  _id = NULL;
+  _scratch = NULL;
+  _far_x = NULL;
+  _far_y = NULL;
+  _far_z = NULL;
+  _tbuf = NULL;
+  _save = NULL;
+  _kernels = NULL;
+  _x_new = NULL;
+  _jbuf = NULL;
+  _tlast = NULL;
+  _dtblock = NULL;
+  _active = NULL;
+  _dtcrit = NULL;
+  _y_new = NULL;
+  _z_new = NULL;
 }
 
 void GSimulation :: set_number_of_particles(int N)  
@@ -41,6 +119,11 @@ void GSimulation :: set_number_of_steps(int N)
   set_nsteps(N);
 }
 
+void GSimulation :: set_time_step(real_type dt)  
+{
+  set_tstep(dt);
+}
+
 void GSimulation :: init_pos()
 {
   std::random_device rd;        //random number generator
@@ -71,6 +154,7 @@ void GSimulation :: init_vel()
 
 void GSimulation :: init_acc()
 {
+  if(particles->acc_x == NULL) return;
   for(int i=0; i<get_npart(); ++i)
   {
     particles->acc_x[i] = 0.f;
@@ -81,7 +165,7 @@ void GSimulation :: init_acc()
 
 void GSimulation :: init_mass()
 {
-  real_type n   = static_cast<real_type> (get_npart());
+  real_type n   = static_cast<real_type> (get_nmassive());
   std::random_device rd;        //random number generator
   std::mt19937 gen(42);
   std::uniform_real_distribution<real_type> unif_d(0.0,1.0);
@@ -90,143 +174,875 @@ void GSimulation :: init_mass()
   {
     particles->mass[i] = n * unif_d(gen);
   }
+  // the tracers feel the others but do not attract them
+  for(int i=get_nmassive(); i<get_npart(); ++i)
+    particles->mass[i] = 0.f;
+}
+
+// Ghost particles fill the arrays up to a multiple of the tile: they have
+// no mass, so they do not change the forces, and they are never moved
+void GSimulation :: init_ghosts()
+{
+  for(int i=get_npart(); i<get_npad(); ++i)
+  {
+    particles->pos_x[i] = 0.f;
+    particles->pos_y[i] = 0.f;
+    particles->pos_z[i] = 0.f;
+    particles->vel_x[i] = 0.f;
+    particles->vel_y[i] = 0.f;
+    particles->vel_z[i] = 0.f;
+    if(particles->acc_x != NULL)
+    {
+      particles->acc_x[i] = 0.f;
+      particles->acc_y[i] = 0.f;
+      particles->acc_z[i] = 0.f;
+    }
+    particles->mass[i]  = 0.f;
+  }
+}
+
+// Kernels built for the named instruction set, or for the best one the CPU
+// supports if the name is empty; NULL if the CPU does not support it
+static const KernelTable *select_kernels(const std::string &isa)
+{
+  __builtin_cpu_init();
+  const bool avx512 = __builtin_cpu_supports("avx512f");
+  const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if(isa == "avx512") return avx512 ? &kernels_avx512 : NULL;
+  if(isa == "avx2") return avx2 ? &kernels_avx2 : NULL;
+  if(isa == "sse42") return &kernels_sse42;
+  if(!isa.empty()) return NULL;
+  if(avx512) return &kernels_avx512;
+  if(avx2) return &kernels_avx2;
+  return &kernels_sse42;
+}
+
+// Advance the particles with block time steps up to t_end, where all of
+// them are synchronized; return the number of interactions
+double GSimulation :: block_step(double t_end)
+{
+  const int n = get_npart();
+  const int np = get_npad();
+  const double dtmax = get_tstep();
+  double ninter = 0.;
+
+  while(_time < t_end)
+  {
+    // the next block time and the compact list of the particles due then
+    double tnext = t_end;
+#pragma omp parallel for reduction(min:tnext)
+    for (int i = 0; i < n; ++i)
+      tnext = std::min(tnext, _tlast[i] + _dtblock[i]);
+    int nact = 0;
+    for (int i = 0; i < n; ++i)
+      if(_tlast[i] + _dtblock[i] == tnext)
+        _active[nact++] = i;
+
+    _kernels->predict_block(particles, np, tnext, _tlast);
+    _kernels->hermite_active(particles, np, G, softeningSquared, _active, nact, _dtblock,
+                             get_eta(), _dtcrit);
+
+    // new steps: halved down to the criterion, doubled (by one level) only
+    // if the criterion allows it and the block times stay aligned
+    for (int k = 0; k < nact; ++k)
+    {
+      const int i = _active[k];
+      double h = _dtblock[i];
+      while(h > _dtcrit[k] && h > dtmax * min_block) h *= 0.5;
+      if(h == _dtblock[i] && 2. * h <= dtmax && 2. * h <= _dtcrit[k] && fmod(tnext, 2. * h) == 0.)
+        h *= 2.;
+      _tlast[i] = tnext;
+      _dtblock[i] = h;
+    }
+
+    _time = tnext;
+    ninter += double(nact) * double(np);
+    _nblock += 1.;
+    _nactive += nact;
+  }
+  return ninter;
+}
+
+// One outer step of the multiple time stepping leapfrog: half kick with
+// the far accelerations, nsub kick-drift-kick steps of dt/nsub with the
+// near ones, new far accelerations and the closing half kick. The far half
+// kicks go through the same kernel, with the far arrays swapped in as the
+// accelerations. Return the number of interactions, and the sum of m v^2
+// in energy if kinetic.
+double GSimulation :: respa_step(real_type dt, bool kinetic, real_type &energy)
+{
+  const int n = get_npart();
+  const real_type h = dt / get_nsub();
+  real_type amax2;
+  double ninter = 0.;
+
+  std::swap(particles->acc_x, _far_x);
+  std::swap(particles->acc_y, _far_y);
+  std::swap(particles->acc_z, _far_z);
+  _kernels->kick(particles, n, dt, false, amax2);
+  std::swap(particles->acc_x, _far_x);
+  std::swap(particles->acc_y, _far_y);
+  std::swap(particles->acc_z, _far_z);
+
+  for (int k = 0; k < get_nsub(); ++k)
+  {
+    _kernels->kick_drift(particles, n, h);
+    ninter += respa->near_forces(particles, n, G, softeningSquared);
+    _kernels->kick(particles, n, h, false, amax2);
+  }
+
+  ninter += _kernels->respa_far(particles, n, get_npad(), G, softeningSquared,
+                                respa->get_inner(), respa->get_cutoff(), _far_x, _far_y, _far_z);
+  std::swap(particles->acc_x, _far_x);
+  std::swap(particles->acc_y, _far_y);
+  std::swap(particles->acc_z, _far_z);
+  energy = _kernels->kick(particles, n, dt, kinetic, amax2);
+  std::swap(particles->acc_x, _far_x);
+  std::swap(particles->acc_y, _far_y);
+  std::swap(particles->acc_z, _far_z);
+  return ninter;
+}
+
+// The potential energy is stored in epot, if given, only by the kernels
+// of kernel_potential()
+double GSimulation :: compute_forces(double *epot)
+{
+  switch(get_force_mode())
+  {
+    case FORCE_BARNES_HUT:
+      return bh->compute_forces(particles, get_npart(), G, softeningSquared);
+    case FORCE_FMM:
+      return fmm->compute_forces(particles, get_npart(), G, softeningSquared);
+    case FORCE_PM:
+      return pm->compute_forces(particles, get_npart(), G);
+    case FORCE_TREEPM:
+      return treepm->compute_forces(particles, get_npart(), G, softeningSquared);
+    case FORCE_CUTOFF:
+      return cells->compute_forces(particles, get_npart(), G, softeningSquared);
+    case FORCE_VERLET:
+      return verlet->compute_forces(particles, get_npart(), _kernels, G, softeningSquared);
+    case FORCE_EWALD:
+      return ewald->compute_forces(particles, get_npart(), get_nsources(), _kernels,
+                                   G, softeningSquared);
+    case FORCE_SYMMETRIC:
+      return _kernels->symmetric(particles, get_npad(), get_nsources(), G, softeningSquared,
+                                 _tbuf, _tbuf_stride);
+    case FORCE_DIRECT:
+    default:
+      if(get_kernel() == KERNEL_INTRIN)
+        return _kernels->direct_intrin(particles, get_npad(), get_nsources(), G, softeningSquared);
+      return _kernels->direct_pragma(particles, get_nsources(), G, softeningSquared,
+                                     get_npad(), get_itile(), get_jtile(), epot, _jbuf);
+  }
+}
+
+// Time the direct sum of a slice of the i particles, against all of them,
+// for every pair of tiles and keep the fastest; tiles set by the user are
+// not changed
+void GSimulation :: tune_tiles()
+{
+  static const int itiles[] = {2, 4, 8, 16};
+  static const int jtiles[] = {256, 512, 1024, 2048, 4096, 8192, 16384};
+  const int n = get_nsources();
+  
+  // about 2e7 interactions per trial, and some tiles for every thread
+  int ni = std::min(get_npad(), std::max(64 * omp_get_max_threads(), (int) (2.e7 / n)));
+  ni = (ni + padding - 1) / padding * padding;
+  
+  CPUTime time;
+  double best = 1.e30;
+  int best_i = get_itile(), best_j = get_jtile();
+  for (int a = 0; a < 4; ++a)
+  {
+    if(get_itile() > 0 && itiles[a] != get_itile()) continue;
+    for (int b = 0; b < 8; ++b)
+    {
+      // the last candidate is a single chunk with all the j particles
+      const int jtile = (b < 7) ? jtiles[b] : n;
+      if(get_jtile() > 0 && jtile != get_jtile()) continue;
+      if(b < 7 && jtile >= n) continue;
+      
+      double t = 1.e30;
+      for (int r = 0; r < 3; ++r)
+      {
+        const double t0 = time.start();
+        if(lowmem_step())
+        {
+          // a kick by 0 leaves the velocities as they are
+          real_type amax2;
+          _kernels->direct_kick(particles, n, G, softeningSquared, ni, itiles[a], jtile, 0.f,
+                                amax2);
+        }
+        else
+          _kernels->direct_pragma(particles, n, G, softeningSquared, ni, itiles[a], jtile, NULL, _jbuf);
+        t = std::min(t, time.stop() - t0);
+      }
+      if(t < best)
+      {
+        best = t;
+        best_i = itiles[a];
+        best_j = jtile;
+      }
+    }
+  }
+  set_itile(best_i);
+  set_jtile(best_j);
+  _tuned = true;
+}
+
+// A particle field of np floats, from the arena if there is one
+real_type *GSimulation :: alloc_field(int np)
+{
+  if(_arena != NULL)
+  {
+    real_type *p = (real_type*) _arena->field();
+    if(p != NULL) return p;
+  }
+  return (real_type*) _mm_malloc(np*sizeof(real_type),alignment);
+}
+
+void GSimulation :: free_field(real_type *p)
+{
+  if(_arena == NULL || !_arena->owns(p))
+    _mm_free(p);
+}
+
+// a[i] = a[perm[i]] for the first n elements, through tmp
+template<typename T>
+static void permute(T *a, T *tmp, const int *perm, int n)
+{
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+    tmp[i] = a[perm[i]];
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+    a[i] = tmp[i];
+}
+
+// Sort the particles along the space filling curve, the tracers after the
+// massive ones, with all their per-particle state
+void GSimulation :: reorder()
+{
+  const int n = get_npart();
+  const int *perm = curve->sort(particles, n, get_nmassive());
+  real_type *ftmp = (real_type*) _scratch;
+  
+  real_type *arrays[] = { particles->pos_x, particles->pos_y, particles->pos_z,
+                          particles->vel_x, particles->vel_y, particles->vel_z,
+                          particles->acc_x, particles->acc_y, particles->acc_z,
+                          particles->mass,
+                          particles->jrk_x, particles->jrk_y, particles->jrk_z,
+                          particles->ppos_x, particles->ppos_y, particles->ppos_z,
+                          particles->pvel_x, particles->pvel_y, particles->pvel_z,
+                          _far_x, _far_y, _far_z };
+  for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); ++a)
+    if(arrays[a] != NULL)
+      permute(arrays[a], ftmp, perm, n);
+  if(_tlast != NULL)
+  {
+    permute(_tlast, (double*) _scratch, perm, n);
+    permute(_dtblock, (double*) _scratch, perm, n);
+  }
+  permute(_id, (int*) _scratch, perm, n);
+  
+  if(verlet != NULL)
+    verlet->invalidate();
+}
+
+// Positions, velocities and mass of every particle, one per line, in the
+// order of the initial conditions
+void GSimulation :: write_output() const
+{
+  const int n = get_npart();
+  std::vector<int> slot(n);
+  for (int i = 0; i < n; ++i)
+    slot[_id[i]] = i;
+  
+  std::ofstream out(get_output().c_str());
+  out << std::setprecision(8);
+  for (int k = 0; k < n; ++k)
+  {
+    const int i = slot[k];
+    out << particles->pos_x[i] << " " << particles->pos_y[i] << " " << particles->pos_z[i] << " "
+        << particles->vel_x[i] << " " << particles->vel_y[i] << " " << particles->vel_z[i] << " "
+        << particles->mass[i] << "\n";
+  }
+  if(!out)
+    std::cout << " Cannot write " << get_output() << std::endl;
+}
+
+// The same direct sum on the particles stored as AoS, SoA and AoSoA, each
+// timed over nsteps evaluations; the accelerations of AoS and AoSoA are
+// compared with the SoA ones
+void GSimulation :: layout_benchmark()
+{
+  const int np = get_npad();
+  std::vector<Particle> aos(np);
+  ParticleAoSoA<block_width> aosoa;
+  aosoa.resize(np);
+  for (int i = 0; i < np; ++i)
+  {
+    aos[i].pos[0] = aosoa.pos_x(i) = particles->pos_x[i];
+    aos[i].pos[1] = aosoa.pos_y(i) = particles->pos_y[i];
+    aos[i].pos[2] = aosoa.pos_z(i) = particles->pos_z[i];
+    aos[i].vel[0] = aosoa.vel_x(i) = particles->vel_x[i];
+    aos[i].vel[1] = aosoa.vel_y(i) = particles->vel_y[i];
+    aos[i].vel[2] = aosoa.vel_z(i) = particles->vel_z[i];
+    aos[i].mass   = aosoa.mass(i)  = particles->mass[i];
+  }
+  
+  std::cout << " nPart = " << get_npart() << "; layout benchmark of the direct sum, "
+	    << get_nsteps() << " evaluations each" << std::endl;
+  std::cout << " Kernels: " << _kernels->isa << "; AoSoA blocks of " << block_width
+	    << " particles" << std::endl;
+  std::cout << "------------------------------------------------" << std::endl;
+  std::cout << " " << std::left << std::setw(8) << "layout"
+	    << std::left << std::setw(12) << "time (s)"
+	    << std::left << std::setw(12) << "GInter/s"
+	    << std::left << std::setw(12) << "accdiff" << std::endl;
+  std::cout << "------------------------------------------------" << std::endl;
+  
+  static const char *names[] = {"soa", "aos", "aosoa"};
+  CPUTime time;
+  for (int l = 0; l < 3; ++l)
+  {
+    // a first evaluation, not timed, touches the pages of the layout
+    double ninter = 0.;
+    double t0 = 0.;
+    for (int s = -1; s < get_nsteps(); ++s)
+    {
+      if(s == 0)
+      {
+        ninter = 0.;
+        t0 = time.start();
+      }
+      if(l == 0)
+        ninter += _kernels->direct_soa(particles, np, G, softeningSquared);
+      else if(l == 1)
+        ninter += _kernels->direct_aos(&aos[0], np, G, softeningSquared);
+      else
+        ninter += _kernels->direct_aosoa(aosoa.blocks(), np, G, softeningSquared);
+    }
+    const double t = time.stop() - t0;
+    
+    double err2 = 0., ref2 = 0.;
+    for (int i = 0; i < get_npart() && l > 0; ++i)
+    {
+      const double ax = (l == 1) ? aos[i].acc[0] : aosoa.acc_x(i);
+      const double ay = (l == 1) ? aos[i].acc[1] : aosoa.acc_y(i);
+      const double az = (l == 1) ? aos[i].acc[2] : aosoa.acc_z(i);
+      err2 += (ax - particles->acc_x[i]) * (ax - particles->acc_x[i])
+            + (ay - particles->acc_y[i]) * (ay - particles->acc_y[i])
+            + (az - particles->acc_z[i]) * (az - particles->acc_z[i]);
+      ref2 += particles->acc_x[i] * particles->acc_x[i]
+            + particles->acc_y[i] * particles->acc_y[i]
+            + particles->acc_z[i] * particles->acc_z[i];
+    }
+    std::cout << " " << std::left << std::setw(8) << names[l]
+	      << std::left << std::setprecision(5) << std::setw(12) << t
+	      << std::left << std::setprecision(5) << std::setw(12) << 1e-9 * ninter / t
+	      << std::left << std::setprecision(5) << std::setw(12) << ((l > 0) ? sqrt(err2 / ref2) : 0.)
+	      << std::endl;
+  }
+  std::cout << "===============================" << std::endl;
+}
+
+// Relative rms deviation of the current accelerations from the direct sum,
+// evaluated in double precision on (at most) 1000 sampled particles; the
+// Hermite accelerations belong to the predicted positions. The periodic
+// modes are compared with a reference Ewald sum.
+double GSimulation :: check_accuracy()
+{
+  const int n = get_npart();
+  const bool predicted = hermite();
+  const real_type *px = predicted ? particles->ppos_x : particles->pos_x;
+  const real_type *py = predicted ? particles->ppos_y : particles->pos_y;
+  const real_type *pz = predicted ? particles->ppos_z : particles->pos_z;
+  const int stride = std::max(1, n / 1000);
+  double err2 = 0., ref2 = 0.;
+
+  if(periodic())
+  {
+    std::vector<double> ref;
+    Ewald::reference(px, py, pz, particles->mass, n, G, softeningSquared, stride, ref);
+    for (int i = 0, s = 0; i < n; i += stride, ++s)
+    {
+      double ex = particles->acc_x[i] - ref[3*s];
+      double ey = particles->acc_y[i] - ref[3*s+1];
+      double ez = particles->acc_z[i] - ref[3*s+2];
+      err2 += ex*ex + ey*ey + ez*ez;
+      ref2 += ref[3*s]*ref[3*s] + ref[3*s+1]*ref[3*s+1] + ref[3*s+2]*ref[3*s+2];
+    }
+    return sqrt(err2 / ref2);
+  }
+
+  // the cutoff modes are compared with the direct sum cut at rc
+  const bool cutoff = get_force_mode() == FORCE_CUTOFF || get_force_mode() == FORCE_VERLET;
+  const real_type rc = get_rcut();
+  const real_type rc2 = cutoff ? rc * rc : std::numeric_limits<real_type>::max();
+
+#pragma omp parallel for reduction(+:err2,ref2)
+  for (int i = 0; i < n; i += stride)
+  {
+    double ax = 0., ay = 0., az = 0.;
+    for (int j = 0; j < n; ++j)
+    {
+      double dx = px[j] - px[i];
+      double dy = py[j] - py[i];
+      double dz = pz[j] - pz[i];
+      // r^2 < rc^2 in single precision, as the kernels test it
+      real_type r2 = (real_type) (dx*dx + dy*dy + dz*dz);
+      if(!(r2 < rc2)) continue;
+      double distanceInv = 1.0 / sqrt(dx*dx + dy*dy + dz*dz + softeningSquared);
+      double f = G * particles->mass[j] * distanceInv * distanceInv * distanceInv;
+      ax += dx * f;
+      ay += dy * f;
+      az += dz * f;
+    }
+    // the RESPA near and far parts add up to the total
+    if(_far_x != NULL)
+    {
+      ax -= _far_x[i];
+      ay -= _far_y[i];
+      az -= _far_z[i];
+    }
+    double ex = particles->acc_x[i] - ax;
+    double ey = particles->acc_y[i] - ay;
+    double ez = particles->acc_z[i] - az;
+    err2 += ex*ex + ey*ey + ez*ez;
+    ref2 += ax*ax + ay*ay + az*az;
+  }
+  return sqrt(err2 / ref2);
+}
+
+// Copy of the state at the beginning of a step: positions, velocities,
+// accelerations and, for Hermite, jerks of the n particles
+void GSimulation :: save_state()
+{
+  const int n = get_npart();
+  real_type *const src[12] = { particles->pos_x, particles->pos_y, particles->pos_z,
+                               particles->vel_x, particles->vel_y, particles->vel_z,
+                               particles->acc_x, particles->acc_y, particles->acc_z,
+                               particles->jrk_x, particles->jrk_y, particles->jrk_z };
+  const int narrays = hermite() ? 12 : 9;
+  for (int a = 0; a < narrays; ++a)
+    if(src[a] != NULL)
+      std::copy(src[a], src[a] + n, _save + a * n);
+}
+
+void GSimulation :: restore_state()
+{
+  const int n = get_npart();
+  real_type *const dst[12] = { particles->pos_x, particles->pos_y, particles->pos_z,
+                               particles->vel_x, particles->vel_y, particles->vel_z,
+                               particles->acc_x, particles->acc_y, particles->acc_z,
+                               particles->jrk_x, particles->jrk_y, particles->jrk_z };
+  const int narrays = hermite() ? 12 : 9;
+  for (int a = 0; a < narrays; ++a)
+    if(dst[a] != NULL)
+      std::copy(_save + a * n, _save + (a + 1) * n, dst[a]);
 }
 
 void GSimulation :: start() 
 {
   real_type energy;
   real_type dt = get_tstep();
+  // the tracers are appended to the massive particles
+  set_npart(get_npart() + get_ntracers());
   int n = get_npart();
-  int i,j;
   
-  const int alignment = 32;
+  _kernels = select_kernels(get_isa());
+  if(_kernels == NULL)
+  {
+    std::cout << " The CPU does not support " << get_isa() << ", using the best available" << std::endl;
+    _kernels = select_kernels("");
+  }
+  
+  // pad the arrays to a multiple of the widest tile with ghost particles,
+  // so that the direct sum kernels need no remainder loop
+  set_npad((n + padding - 1) / padding * padding);
+  const int np = get_npad();
+  
   particles = (ParticleSoA*) _mm_malloc(sizeof(ParticleSoA),alignment);
+  particles->init();
+  
+  if(!get_pages().empty())
+  {
+    // the fields of the particles, of the RESPA far force and of the fused
+    // step in one mapping
+    const int nfields = (lowmem_step() ? 7 : 10) + (hermite() ? 9 : 0) + (get_integrator() == INTEGRATOR_RESPA ? 3 : 0)
+                      + (fused_step() ? 3 : 0);
+    _arena = new Arena();
+    _arena->reserve(np*sizeof(real_type), nfields, get_pages() == "hugetlb");
+  }
 
-  particles->pos_x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->pos_y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->pos_z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->vel_x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->vel_y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->vel_z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->acc_x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->acc_y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->acc_z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
-  particles->mass  = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  particles->pos_x = alloc_field(np);
+  particles->pos_y = alloc_field(np);
+  particles->pos_z = alloc_field(np);
+  particles->vel_x = alloc_field(np);
+  particles->vel_y = alloc_field(np);
+  particles->vel_z = alloc_field(np);
+  // the low memory step has its accelerations only in the kernel's buffers
+  if(!lowmem_step())
+  {
+    particles->acc_x = alloc_field(np);
+    particles->acc_y = alloc_field(np);
+    particles->acc_z = alloc_field(np);
+  }
+  particles->mass  = alloc_field(np);
+  
+  if(hermite())
+  {
+    if(get_force_mode() != FORCE_DIRECT)
+    {
+      std::cout << " The Hermite integrator needs the direct sum, using it" << std::endl;
+      set_force_mode(FORCE_DIRECT);
+    }
+    particles->jrk_x  = alloc_field(np);
+    particles->jrk_y  = alloc_field(np);
+    particles->jrk_z  = alloc_field(np);
+    particles->ppos_x = alloc_field(np);
+    particles->ppos_y = alloc_field(np);
+    particles->ppos_z = alloc_field(np);
+    particles->pvel_x = alloc_field(np);
+    particles->pvel_y = alloc_field(np);
+    particles->pvel_z = alloc_field(np);
+  }
+  if(get_integrator() == INTEGRATOR_RESPA)
+  {
+    if(get_force_mode() != FORCE_DIRECT)
+    {
+      std::cout << " The RESPA integrator splits the direct sum, using it" << std::endl;
+      set_force_mode(FORCE_DIRECT);
+    }
+    respa = new Respa(get_rcut());
+    _far_x = alloc_field(np);
+    _far_y = alloc_field(np);
+    _far_z = alloc_field(np);
+  }
+  if(get_integrator() == INTEGRATOR_BLOCK)
+  {
+    _tlast   = (double*) _mm_malloc(np*sizeof(double),alignment);
+    _dtblock = (double*) _mm_malloc(np*sizeof(double),alignment);
+    _active  = (int*) _mm_malloc(n*sizeof(int),alignment);
+    _dtcrit  = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  }
+  
+  if(get_force_mode() == FORCE_BARNES_HUT)
+    bh = new BarnesHut(get_theta());
+  if(get_force_mode() == FORCE_FMM)
+    fmm = new FMM(get_order());
+  if(get_force_mode() == FORCE_PM)
+  {
+    // smoothing close to the Plummer softening of the direct sum
+    pm = new ParticleMesh(get_ngrid());
+    pm->set_split(0.6f * sqrtf(softeningSquared));
+  }
+  if(get_force_mode() == FORCE_TREEPM)
+    treepm = new TreePM(get_ngrid(), get_rsplit());
+  if(get_force_mode() == FORCE_CUTOFF)
+    cells = new CellList(get_rcut());
+  if(get_force_mode() == FORCE_VERLET)
+    verlet = new VerletList(get_rcut(), get_skin());
+  if(get_force_mode() == FORCE_EWALD)
+    ewald = new Ewald(get_alpha(), get_kmax());
+  if(get_packed() && get_force_mode() == FORCE_DIRECT && get_kernel() == KERNEL_PRAGMA &&
+     !hermite() && get_integrator() != INTEGRATOR_RESPA && !fused_step() && !lowmem_step())
+    _jbuf = (real_type*) _mm_malloc(4*np*sizeof(real_type),64);
+  if(fused_step())
+  {
+    // second position buffer, written while the first one is read
+    _x_new = alloc_field(np);
+    _y_new = alloc_field(np);
+    _z_new = alloc_field(np);
+    // the fused kernel streams all j at once: only the i tile is tuned
+    set_jtile(get_nsources());
+  }
+  if(get_lowmem() && !lowmem_step())
+    std::cout << " The low memory step needs the pragma direct sum and the Euler integrator,"
+              << " ignoring -lowmem" << std::endl;
+  if(lowmem_step() && get_check())
+  {
+    std::cout << " The low memory step keeps no accelerations, ignoring -check" << std::endl;
+    set_check(false);
+  }
+  if(adaptive() && get_reject() > 0. && !has_energy())
+  {
+    std::cout << " Steps cannot be rejected without the total energy, keeping all" << std::endl;
+    set_reject(0.);
+  }
+  if(get_adaptive() > 0. && !adaptive())
+    std::cout << " The integrator has its own time steps, ignoring -adaptive" << std::endl;
+  if(adaptive() && get_reject() > 0.)
+    _save = (real_type*) _mm_malloc(12*n*sizeof(real_type),alignment);
+  if(get_force_mode() == FORCE_SYMMETRIC)
+  {
+    // one cache line aligned buffer per thread and component
+    _tbuf_stride = np;
+    _tbuf = (real_type*) _mm_malloc(3*omp_get_max_threads()*_tbuf_stride*sizeof(real_type),64);
+  }
   
   init_pos();	
   init_vel();
   init_acc();
   init_mass();
+  init_ghosts();
+  
+  _id = (int*) _mm_malloc(np*sizeof(int),alignment);
+  for (int i = 0; i < np; ++i)
+    _id[i] = i;
+  if(get_reorder() > 0)
+  {
+    curve = new SpaceCurve(get_curve());
+    _scratch = _mm_malloc(np*sizeof(double),alignment);
+  }
+  
+  if(get_layout())
+  {
+    layout_benchmark();
+    return;
+  }
+  
+  if(get_force_mode() == FORCE_DIRECT && get_kernel() == KERNEL_PRAGMA &&
+     !hermite() && get_integrator() != INTEGRATOR_RESPA)
+  {
+    if(get_itile() <= 0 || get_jtile() <= 0)
+      tune_tiles();
+  }
   
   print_header();
   
   _totTime = 0.; 
   
-  const float softeningSquared = 1.e-3f;
-  const float G = 6.67259e-11f;
-  
   CPUTime time;
   double ts0 = 0;
   double ts1 = 0;
   double nd = double(n);
-  double gflops = 1e-9 * ( (11. + 18. ) * nd*nd  +  nd * 19. );
+  double gflops = 1e-9 * ( (11. + 18. ) * nd*get_nmassive()  +  nd * 19. );
   double av=0.0, dev=0.0;
+  double accerr = 0.;
   int nf = 0;
   
-  const int tileSize = 8;
-
+  // leapfrog needs the accelerations of the initial positions, Hermite
+  // the accelerations and jerks as well
+  if(get_integrator() == INTEGRATOR_LEAPFROG)
+    compute_forces();
+  if(get_integrator() == INTEGRATOR_RESPA)
+  {
+    respa->near_forces(particles, n, G, softeningSquared);
+    _kernels->respa_far(particles, n, np, G, softeningSquared,
+                        respa->get_inner(), respa->get_cutoff(), _far_x, _far_y, _far_z);
+  }
+  if(hermite())
+  {
+    for (int i = 0; i < np; ++i)
+    {
+      particles->jrk_x[i] = 0.f;
+      particles->jrk_y[i] = 0.f;
+      particles->jrk_z[i] = 0.f;
+    }
+    _kernels->predict(particles, np, 0.f);
+    real_type amax2;
+    _kernels->hermite(particles, n, np, G, softeningSquared, dt, false, false, amax2);
+  }
+  if(get_integrator() == INTEGRATOR_BLOCK)
+  {
+    // first steps from 0.01 |a|/|j|, the largest power of two fraction of dt
+    // below it
+    for (int i = 0; i < np; ++i)
+    {
+      const double a = sqrt(particles->acc_x[i]*particles->acc_x[i] +
+                            particles->acc_y[i]*particles->acc_y[i] +
+                            particles->acc_z[i]*particles->acc_z[i]);
+      const double j = sqrt(particles->jrk_x[i]*particles->jrk_x[i] +
+                            particles->jrk_y[i]*particles->jrk_y[i] +
+                            particles->jrk_z[i]*particles->jrk_z[i]);
+      double h = dt;
+      while(j > 0. && h > 0.01 * a / j && h > dt * min_block) h *= 0.5;
+      _tlast[i] = 0.;
+      _dtblock[i] = h;
+    }
+    _time = 0.;
+  }
+  _nblock = 0.;
+  _nactive = 0.;
+  
+  // total energy of the initial conditions
+  double e0 = 0.;
+  if(has_energy())
+  {
+    for (int i = 0; i < n; ++i)
+      e0 += 0.5 * particles->mass[i] * (particles->vel_x[i]*particles->vel_x[i] +
+                                        particles->vel_y[i]*particles->vel_y[i] +
+                                        particles->vel_z[i]*particles->vel_z[i]);
+    e0 += _kernels->potential(particles, get_nmassive(), G, softeningSquared);
+  }
+  
+  _ninter = 0.;
+  
+  // adaptive steps: the run covers the simulated time of nsteps fixed steps
+  // unless told otherwise, the last step is cut to end on it
+  const double tend = (get_tend() > 0.) ? get_tend() : get_nsteps() * (double) dt;
+  double t = 0.;
+  double eprev = e0;
+  real_type amax2 = 0.;
+  // a rejected step caps the next ones at 0.9 of it, the cap grows by 1%
+  // per accepted step; no growth at all right after a rejection
+  double dtcap = 0.;
+  bool rejected = false;
+  int nsteps = 0;
+  _nreject = 0;
+  
   const double t0 = time.start();
-  for (int s=1; s<=get_nsteps(); ++s)
+  for (int s=1; adaptive() ? t < tend * (1. - 1.e-6) : s<=get_nsteps(); ++s)
   {   
+   if(adaptive() && t + dt > tend)
+     dt = tend - t;
    ts0 += time.start();
-#pragma omp parallel for 
-   for (int ii = 0; ii < n; ii += tileSize )
+   if(get_reorder() > 0 && (s - 1) % get_reorder() == 0)
+     reorder();
+   if(_save != NULL)
+     save_state();
+   // the energies are needed on sample steps and to reject steps; the
+   // potential comes from the force kernel if it can give it
+   const bool sample = !(s%get_sfreq());
+   const bool energies = sample || _save != NULL;
+   double epot = 0.;
+   double *kpot = (energies && kernel_potential()) ? &epot : NULL;
+   const bool check = get_check() && sample;
+   if(get_integrator() == INTEGRATOR_LEAPFROG)
+     _kernels->kick_drift(particles, n, dt);
+   if(get_integrator() == INTEGRATOR_HERMITE)
    {
-     real_type acc_xtile[tileSize];
-     real_type acc_ytile[tileSize] ;
-     real_type acc_ztile[tileSize];
-     #pragma omp simd
-     for(int s=0; s<tileSize; s++)
-     {
-       acc_xtile[s] = 0.0f;
-       acc_ytile[s] = 0.0f;
-       acc_ztile[s] = 0.0f;
-     }
-     __assume_aligned(particles->pos_x, alignment);
-     __assume_aligned(particles->pos_y, alignment);
-     __assume_aligned(particles->pos_z, alignment);
-     __assume_aligned(particles->acc_x, alignment);
-     __assume_aligned(particles->acc_y, alignment);
-     __assume_aligned(particles->acc_z, alignment);
-     __assume_aligned(particles->mass, alignment);
-     
-     real_type ax_i = particles->acc_x[i];
-     real_type ay_i = particles->acc_y[i];
-     real_type az_i = particles->acc_z[i];
-     #pragma omp simd
-     for (j = 0; j < n; j++)
-     {
-      for (int i = ii; i < ii + tileSize; i++)
-       {
-         real_type dx, dy, dz;
-	 real_type distanceSqr = 0.0f;
-	 real_type distanceInv = 0.0f;
-		  
-	 dx = particles->pos_x[j] - particles->pos_x[i];	//1flop
-	 dy = particles->pos_y[j] - particles->pos_y[i];	//1flop	
-	 dz = particles->pos_z[j] - particles->pos_z[i];	//1flop
-	
- 	 distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
- 	 distanceInv = 1.0f / sqrtf(distanceSqr);			//1div+1sqrt
-
-	acc_xtile[i-ii] += dx * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
-	acc_ytile[i-ii] += dy * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
-	acc_ztile[i-ii] += dz * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
-        }
-     }
-     #pragma omp simd
-     for(int s=0; s<tileSize; s++)
+     _kernels->predict(particles, np, dt);
+     energy = _kernels->hermite(particles, n, np, G, softeningSquared, dt, true, energies, amax2);
+     _ninter += double(np) * double(np);
+   }
+   else if(get_integrator() == INTEGRATOR_BLOCK)
+   {
+     // all the particles are synchronized at the end of the step
+     _ninter += block_step(s * (double) dt);
+     energy = 0;
+     if(energies)
      {
-       particles->acc_x[s+ii] = acc_xtile[s];
-       particles->acc_y[s+ii] = acc_ytile[s];
-       particles->acc_z[s+ii] = acc_ztile[s];
+#pragma omp parallel for reduction(+:energy)
+       for (int i = 0; i < n; ++i)
+         energy += particles->mass[i] * (particles->vel_x[i]*particles->vel_x[i] +
+                                         particles->vel_y[i]*particles->vel_y[i] +
+                                         particles->vel_z[i]*particles->vel_z[i]);
      }
    }
-   energy = 0;
-#pragma omp parallel for reduction(+:energy)
-   for (i = 0; i < n; ++i)// update position
+   else if(get_integrator() == INTEGRATOR_RESPA)
+     _ninter += respa_step(dt, energies, energy);
+   else if(fused_step())
    {
-     particles->vel_x[i] += particles->acc_x[i] * dt; //2flops
-     particles->vel_y[i] += particles->acc_y[i] * dt; //2flops
-     particles->vel_z[i] += particles->acc_z[i] * dt; //2flops
-	  
-     particles->pos_x[i] += particles->vel_x[i] * dt; //2flops
-     particles->pos_y[i] += particles->vel_y[i] * dt; //2flops
-     particles->pos_z[i] += particles->vel_z[i] * dt; //2flops
-
-     particles->acc_x[i] = 0.;
-     particles->acc_y[i] = 0.;
-     particles->acc_z[i] = 0.;
-	
-     energy += particles->mass[i] * (
-	       particles->vel_x[i]*particles->vel_x[i] + 
-               particles->vel_y[i]*particles->vel_y[i] +
-               particles->vel_z[i]*particles->vel_z[i]); //7flops
+     // the accelerations are stored only for the comparison below
+     energy = _kernels->fused(particles, n, np, get_nsources(), G, softeningSquared, dt, get_itile(),
+                              _x_new, _y_new, _z_new, check, energies, amax2);
+     _ninter += double(np) * double(get_nsources());
+   }
+   else if(lowmem_step())
+   {
+     _kernels->direct_kick(particles, get_nsources(), G, softeningSquared, np, get_itile(),
+                           get_jtile(), dt, amax2);
+     _ninter += double(np) * double(get_nsources());
+   }
+   else
+     _ninter += compute_forces(kpot);
+   
+   if(check)
+   {
+     // the comparison with the direct sum is not part of the timing
+     ts1 += time.stop();
+     accerr = check_accuracy();
+     ts0 += time.start();
+   }
+   
+   if(fused_step())
+   {
+     std::swap(particles->pos_x, _x_new);
+     std::swap(particles->pos_y, _y_new);
+     std::swap(particles->pos_z, _z_new);
+   }
+   else if(get_integrator() == INTEGRATOR_LEAPFROG)
+     energy = _kernels->kick(particles, n, dt, energies, amax2);
+   else if(lowmem_step())
+     energy = _kernels->drift(particles, n, dt, energies);
+   else if(get_integrator() == INTEGRATOR_EULER)
+     energy = _kernels->update(particles, n, dt, energies, amax2);
+   // periodic modes: the particles leaving the box enter from the other side
+   if(periodic())
+   {
+#pragma omp parallel for
+     for (int i = 0; i < n; ++i)
+     {
+       particles->pos_x[i] -= floorf(particles->pos_x[i]);
+       particles->pos_y[i] -= floorf(particles->pos_y[i]);
+       particles->pos_z[i] -= floorf(particles->pos_z[i]);
+     }
    }
-  
     _kenergy = 0.5 * energy; 
     
+    if(_save != NULL)
+    {
+      // a step over the energy budget is taken again with half the step
+      if(kpot == NULL)
+        epot = _kernels->potential(particles, get_nmassive(), G, softeningSquared);
+      const double e = _kenergy + epot;
+      if(fabs((e - eprev) / eprev) > get_reject() && dt > get_tstep() * min_block)
+      {
+        restore_state();
+        dtcap = 0.9 * dt;
+        dt *= 0.5;
+        rejected = true;
+        _nreject++;
+        ts1 += time.stop();
+        --s;
+        continue;
+      }
+      eprev = e;
+    }
+    nsteps++;
+    t += dt;
+    if(adaptive())
+    {
+      // dt = eta sqrt(eps / |a|max), growing at most by two per step and
+      // kept below the cap of the rejected steps
+      const real_type dtacc = get_adaptive() * sqrt(sqrt(softeningSquared / amax2));
+      const double dtmax = rejected ? dt : (dtcap > 0.) ? std::min(2. * dt, dtcap) : 2. * dt;
+      dt = (dtacc < dtmax) ? dtacc : dtmax;
+      dtcap *= 1.01;
+      rejected = false;
+    }
+    
+    // the separate potential energy pass of the modes whose force kernel does
+    // not give it is part of the timing of the sample steps
+    if(sample && has_energy() && kpot == NULL && _save == NULL)
+      epot = _kernels->potential(particles, get_nmassive(), G, softeningSquared);
+    
     ts1 += time.stop();
-    if(!(s%get_sfreq()) ) 
+    if(sample) 
     {
       nf += 1;      
+      // total energy and its drift
+      const double etot = _kenergy + epot;
+      const double enerr = fabs((etot - e0) / e0);
       std::cout << " " 
 		<<  std::left << std::setw(8)  << s
-		<<  std::left << std::setprecision(5) << std::setw(8)  << s*get_tstep()
-		<<  std::left << std::setprecision(5) << std::setw(12) << _kenergy
+		<<  std::left << std::setprecision(5) << std::setw(adaptive() ? 12 : 8)
+		<< (adaptive() ? dt : s*get_tstep());
+      if(adaptive())
+	std::cout << std::left << std::setprecision(5) << std::setw(12) << t;
+      std::cout << std::left << std::setprecision(5) << std::setw(12) << _kenergy
 		<<  std::left << std::setprecision(5) << std::setw(12) << (ts1 - ts0)
 		<<  std::left << std::setprecision(5) << std::setw(12) << gflops*get_sfreq()/(ts1 - ts0)
-		<<  std::endl;
+		<<  std::left << std::setprecision(5) << std::setw(12) << 1e-9*_ninter/(ts1 - ts0);
+      if(has_energy())
+	std::cout << std::left << std::setprecision(5) << std::setw(12) << etot
+		  << std::left << std::setprecision(5) << std::setw(12) << enerr;
+      if(get_check())
+	std::cout << std::left << std::setprecision(5) << std::setw(12) << accerr;
+      std::cout << std::endl;
       if(nf > 2) 
       {
 	av  += gflops*get_sfreq()/(ts1 - ts0);
@@ -235,16 +1051,21 @@ void GSimulation :: start()
       
       ts0 = 0;
       ts1 = 0;
+      _ninter = 0.;
     }
   
   } //end of the time step loop
   
   const double t1 = time.stop();
   _totTime  = (t1-t0);
-  _totFlops = gflops*get_nsteps();
+  _totFlops = gflops*nsteps;
   
-  av/=(double)(nf-2);
-  dev=sqrt(dev/(double)(nf-2)-av*av);
+  // the first two samples are not averaged
+  if(nf > 2)
+  {
+    av/=(double)(nf-2);
+    dev=sqrt(dev/(double)(nf-2)-av*av);
+  }
   
   int nthreads=1;
   #pragma omp parallel
@@ -253,8 +1074,22 @@ void GSimulation :: start()
   std::cout << std::endl;
   std::cout << "# Number Threads     : " << nthreads << std::endl;	   
   std::cout << "# Total Time (s)     : " << _totTime << std::endl;
-  std::cout << "# Average Perfomance : " << av << " +- " <<  dev << std::endl;
+  if(get_integrator() == INTEGRATOR_BLOCK)
+    std::cout << "# Block Steps        : " << _nblock << " (" << _nactive / _nblock
+	      << " active particles on average)" << std::endl;
+  if(get_force_mode() == FORCE_VERLET)
+    std::cout << "# Verlet List Builds : " << verlet->get_nbuilds() << std::endl;
+  if(adaptive())
+    std::cout << "# Simulated Time     : " << t << " in " << nsteps << " steps, "
+	      << _nreject << " rejected" << std::endl;
+  if(nf > 2)
+    std::cout << "# Average Perfomance : " << av << " +- " <<  dev << std::endl;
+  else
+    std::cout << "# Average Perfomance : n/a (" << nf << " samples, 3 or more needed)" << std::endl;
   std::cout << "===============================" << std::endl;
+  
+  if(!get_output().empty())
+    write_output();
 
 }
 
@@ -265,15 +1100,92 @@ void GSimulation :: print_header()
   std::cout << " nPart = " << get_npart()  << "; " 
 	    << "nSteps = " << get_nsteps() << "; " 
 	    << "dt = "     << get_tstep()  << std::endl;
+  if(get_ntracers() > 0)
+    std::cout << " Massive particles: " << get_nmassive() << "; tracers: " << get_ntracers() << std::endl;
+  if(adaptive())
+  {
+    std::cout << " Adaptive time step: eta = " << get_adaptive() << "; tend = "
+	      << ((get_tend() > 0.) ? get_tend() : get_nsteps() * get_tstep());
+    if(get_reject() > 0.)
+      std::cout << "; energy error budget per step = " << get_reject();
+    std::cout << std::endl;
+  }
+  std::cout << " Kernels: " << _kernels->isa << std::endl;
+  if(_arena != NULL)
+  {
+    size_t huge;
+    const size_t page = _arena->page_size(huge);
+    std::cout << " Arena: " << _arena->get_nfields() << " fields, " << _arena->get_size() / 1024
+	      << " kB; pages of " << page / 1024 << " kB";
+    if(_arena->get_hugetlb())
+      std::cout << " from the hugetlb pool";
+    else if(huge > 0)
+      std::cout << ", transparent, " << huge / 1024 << " kB of them";
+    std::cout << std::endl;
+  }
+  if(get_reorder() > 0)
+    std::cout << " Particles sorted along the " << ((get_curve() == CURVE_HILBERT) ? "Hilbert" : "Morton")
+	      << " curve every " << get_reorder() << " steps" << std::endl;
+  if(get_integrator() == INTEGRATOR_LEAPFROG)
+    std::cout << " Integrator: leapfrog (kick-drift-kick)" << std::endl;
+  else if(get_integrator() == INTEGRATOR_HERMITE)
+    std::cout << " Integrator: 4th order Hermite" << std::endl;
+  else if(get_integrator() == INTEGRATOR_BLOCK)
+    std::cout << " Integrator: 4th order Hermite, block time steps; eta = " << get_eta() << std::endl;
+  else if(get_integrator() == INTEGRATOR_RESPA)
+    std::cout << " Integrator: RESPA leapfrog; " << get_nsub() << " near steps per far step" << std::endl;
+  else
+    std::cout << " Integrator: symplectic Euler" << std::endl;
+  if(get_force_mode() == FORCE_BARNES_HUT)
+    std::cout << " Force: Barnes-Hut; theta = " << get_theta() << std::endl;
+  else if(get_force_mode() == FORCE_FMM)
+    std::cout << " Force: FMM; order = " << fmm->get_order() << std::endl;
+  else if(get_force_mode() == FORCE_PM)
+    std::cout << " Force: periodic PM; grid = " << pm->get_ngrid() << "^3; smoothing = "
+	      << pm->get_split() << std::endl;
+  else if(get_force_mode() == FORCE_TREEPM)
+    std::cout << " Force: periodic TreePM; grid = " << treepm->get_ngrid() << "^3; "
+	      << "rs = " << treepm->get_split() << "; rcut = " << treepm->get_cutoff() << std::endl;
+  else if(get_force_mode() == FORCE_EWALD)
+    std::cout << " Force: periodic Ewald sum; alpha = " << ewald->get_alpha() << "; kmax = "
+	      << ewald->get_kmax() << " (" << ewald->get_nk() << " k-vectors)" << std::endl;
+  else if(get_force_mode() == FORCE_SYMMETRIC)
+    std::cout << " Force: symmetric direct sum" << std::endl;
+  else if(get_force_mode() == FORCE_CUTOFF)
+    std::cout << " Force: cutoff at rc = " << cells->get_cutoff() << "; linked cells" << std::endl;
+  else if(get_force_mode() == FORCE_VERLET)
+    std::cout << " Force: cutoff at rc = " << verlet->get_cutoff() << "; Verlet lists, skin = "
+	      << verlet->get_skin() << std::endl;
+  else if(hermite())
+    std::cout << " Force: direct sum with jerk" << std::endl;
+  else if(get_integrator() == INTEGRATOR_RESPA)
+    std::cout << " Force: direct sum split from r = " << respa->get_inner() << " to rc = "
+	      << respa->get_cutoff() << "; near part with the octree" << std::endl;
+  else if(get_kernel() == KERNEL_INTRIN)
+    std::cout << " Force: direct sum; kernel = intrinsics" << std::endl;
+  else
+    std::cout << " Force: direct sum; tiles: i = " << get_itile() << ", j = " << get_jtile()
+	      << (_tuned ? " (tuned)" : "") << (fused_step() ? "; fused with the update" : "")
+	      << (lowmem_step() ? "; kick in the direct sum, no accelerations" : "")
+	      << ((_jbuf != NULL) ? "; packed j" : "")
+	      << std::endl;
 	    
   std::cout << "------------------------------------------------" << std::endl;
   std::cout << " " 
 	    <<  std::left << std::setw(8)  << "s"
-	    <<  std::left << std::setw(8)  << "dt"
-	    <<  std::left << std::setw(12) << "kenergy"
+	    <<  std::left << std::setw(adaptive() ? 12 : 8) << "dt";
+  if(adaptive())
+    std::cout << std::left << std::setw(12) << "time";
+  std::cout <<  std::left << std::setw(12) << "kenergy"
 	    <<  std::left << std::setw(12) << "time (s)"
 	    <<  std::left << std::setw(12) << "GFlops"
-	    <<  std::endl;
+	    <<  std::left << std::setw(12) << "GInter/s";
+  if(has_energy())
+    std::cout << std::left << std::setw(12) << "etotal"
+	      << std::left << std::setw(12) << "enerr";
+  if(get_check())
+    std::cout << std::left << std::setw(12) << "accerr";
+  std::cout << std::endl;
   std::cout << "------------------------------------------------" << std::endl;
 
 
@@ -281,15 +1193,50 @@ void GSimulation :: print_header()
 
 GSimulation :: ~GSimulation()
 {
-  _mm_free(particles->pos_x);
-  _mm_free(particles->pos_y);
-  _mm_free(particles->pos_z);
-  _mm_free(particles->vel_x);
-  _mm_free(particles->vel_y);
-  _mm_free(particles->vel_z);
-  _mm_free(particles->acc_x);
-  _mm_free(particles->acc_y);
-  _mm_free(particles->acc_z);
-  _mm_free(particles->mass);
+  delete bh;
+  delete fmm;
+  delete pm;
+  delete treepm;
+  delete respa;
+  delete cells;
+  delete verlet;
+  delete ewald;
+  delete curve;
+  _mm_free(_id);
+  _mm_free(_scratch);
+  free_field(_far_x);
+  free_field(_far_y);
+  free_field(_far_z);
+  _mm_free(_tbuf);
+  _mm_free(_save);
+  free_field(_x_new);
+  _mm_free(_jbuf);
+  free_field(_y_new);
+  free_field(_z_new);
+  _mm_free(_tlast);
+  _mm_free(_dtblock);
+  _mm_free(_active);
+  _mm_free(_dtcrit);
+  if(particles == NULL) return;
+  free_field(particles->pos_x);
+  free_field(particles->pos_y);
+  free_field(particles->pos_z);
+  free_field(particles->vel_x);
+  free_field(particles->vel_y);
+  free_field(particles->vel_z);
+  free_field(particles->acc_x);
+  free_field(particles->acc_y);
+  free_field(particles->acc_z);
+  free_field(particles->mass);
+  free_field(particles->jrk_x);
+  free_field(particles->jrk_y);
+  free_field(particles->jrk_z);
+  free_field(particles->ppos_x);
+  free_field(particles->ppos_y);
+  free_field(particles->ppos_z);
+  free_field(particles->pvel_x);
+  free_field(particles->pvel_y);
+  free_field(particles->pvel_z);
   _mm_free(particles);
+  delete _arena;
 }
@@ -32,6 +32,46 @@
 #include <omp.h>
 
 #include "Particle.hpp"
+#include "SpaceCurve.hpp"
+
+class BarnesHut;
+class FMM;
+class ParticleMesh;
+class TreePM;
+class Respa;
+class CellList;
+class VerletList;
+class Ewald;
+class Arena;
+struct KernelTable;
+
+enum ForceMode
+{
+  FORCE_DIRECT,			//tiled all-pairs direct sum
+  FORCE_BARNES_HUT,		//octree with opening angle theta
+  FORCE_FMM,			//fast multipole method of a given order
+  FORCE_PM,			//periodic particle-mesh
+  FORCE_TREEPM,			//periodic short range tree plus long range mesh
+  FORCE_SYMMETRIC,		//direct sum evaluating each pair once
+  FORCE_CUTOFF,			//pairs closer than a cutoff, with linked cells
+  FORCE_VERLET,			//pairs closer than a cutoff, with Verlet lists
+  FORCE_EWALD			//periodic direct sum with Ewald summation
+};
+
+enum Integrator
+{
+  INTEGRATOR_EULER,		//symplectic Euler, first order
+  INTEGRATOR_LEAPFROG,		//kick-drift-kick leapfrog, second order
+  INTEGRATOR_HERMITE,		//predictor-corrector with jerk, fourth order
+  INTEGRATOR_BLOCK,		//Hermite with power of two block time steps
+  INTEGRATOR_RESPA		//leapfrog with the far force every nsub near steps
+};
+
+enum KernelKind
+{
+  KERNEL_PRAGMA,		//direct sum vectorized by the compiler
+  KERNEL_INTRIN			//direct sum written with intrinsics
+};
 
 class GSimulation 
 {
@@ -42,12 +82,136 @@ public:
   void init();
   void set_number_of_particles(int N);
   void set_number_of_steps(int N);
+  void set_time_step(real_type dt);
   void start();
   
+  inline void set_force_mode(const ForceMode &mode){ _mode = mode; }
+  inline ForceMode get_force_mode() const {return _mode; }
+  
+  inline void set_kernel(const KernelKind &kernel){ _kernel = kernel; }
+  inline KernelKind get_kernel() const {return _kernel; }
+  
+  inline void set_itile(const int &itile){ _itile = itile; }
+  inline int get_itile() const {return _itile; }
+  
+  inline void set_jtile(const int &jtile){ _jtile = jtile; }
+  inline int get_jtile() const {return _jtile; }
+  
+  inline void set_integrator(const Integrator &integrator){ _integrator = integrator; }
+  inline Integrator get_integrator() const {return _integrator; }
+  
+  inline void set_eta(const real_type &eta){ _eta = eta; }
+  inline real_type get_eta() const {return _eta; }
+  
+  inline void set_fused(const bool &fused){ _fused = fused; }
+  inline bool get_fused() const {return _fused; }
+  
+  inline void set_lowmem(const bool &lowmem){ _lowmem = lowmem; }
+  inline bool get_lowmem() const {return _lowmem; }
+  
+  inline void set_packed(const bool &packed){ _packed = packed; }
+  inline bool get_packed() const {return _packed; }
+  
+  inline void set_isa(const std::string &isa){ _isa = isa; }
+  inline const std::string &get_isa() const {return _isa; }
+  
+  inline void set_theta(const real_type &theta){ _theta = theta; }
+  inline real_type get_theta() const {return _theta; }
+  
+  inline void set_order(const int &order){ _order = order; }
+  inline int get_order() const {return _order; }
+  
+  inline void set_ngrid(const int &ngrid){ _ngrid = ngrid; }
+  inline int get_ngrid() const {return _ngrid; }
+  
+  inline void set_rsplit(const real_type &rs){ _rsplit = rs; }
+  inline real_type get_rsplit() const {return _rsplit; }
+  
+  inline void set_check(const bool &check){ _check = check; }
+  inline bool get_check() const {return _check; }
+  
+  inline void set_ntracers(const int &N){ _ntracers = N; }
+  inline int get_ntracers() const {return _ntracers; }
+  
+  inline void set_nsub(const int &nsub){ _nsub = nsub; }
+  inline int get_nsub() const {return _nsub; }
+  
+  inline void set_rcut(const real_type &rc){ _rcut = rc; }
+  inline real_type get_rcut() const {return _rcut; }
+  
+  inline void set_skin(const real_type &skin){ _skin = skin; }
+  inline real_type get_skin() const {return _skin; }
+  
+  inline void set_adaptive(const real_type &eta){ _adaptive = eta; }
+  inline real_type get_adaptive() const {return _adaptive; }
+  
+  inline void set_reject(const real_type &tol){ _reject = tol; }
+  inline real_type get_reject() const {return _reject; }
+  
+  inline void set_tend(const double &tend){ _tend = tend; }
+  inline double get_tend() const {return _tend; }
+  
+  inline void set_alpha(const real_type &alpha){ _alpha = alpha; }
+  inline real_type get_alpha() const {return _alpha; }
+  
+  inline void set_kmax(const int &kmax){ _kmax = kmax; }
+  inline int get_kmax() const {return _kmax; }
+  
+  inline void set_layout(const bool &layout){ _layout = layout; }
+  inline bool get_layout() const {return _layout; }
+  
+  inline void set_reorder(const int &K){ _reorder = K; }
+  inline int get_reorder() const {return _reorder; }
+  
+  inline void set_curve(const CurveKind &kind){ _curve = kind; }
+  inline CurveKind get_curve() const {return _curve; }
+  
+  inline void set_output(const std::string &file){ _output = file; }
+  inline const std::string &get_output() const {return _output; }
+  
+  inline void set_pages(const std::string &pages){ _pages = pages; }
+  inline const std::string &get_pages() const {return _pages; }
+  
 private:
   ParticleSoA *particles;
+  BarnesHut   *bh;
+  FMM         *fmm;
+  ParticleMesh *pm;
+  TreePM      *treepm;
+  Respa       *respa;
+  CellList    *cells;
+  VerletList  *verlet;
+  Ewald       *ewald;
+  SpaceCurve  *curve;
+  Arena       *_arena;	//one mapping for the particle fields, NULL for none
+  
+  const KernelTable *_kernels;	//kernels of the instruction set in use
+  
+  real_type *_x_new, *_y_new, *_z_new;	//positions written by the fused step
+  real_type *_jbuf;		//packed j particles of the direct sum, NULL if not packed
+  
+  double    *_tlast;		//block steps: time of the last correction
+  double    *_dtblock;		//block steps: current step of every particle
+  int       *_active;		//block steps: compact list of the active particles
+  real_type *_dtcrit;		//block steps: step criterion of the active particles
+  double     _time;		//block steps: time of the system
+  double     _nblock;		//block steps taken
+  double     _nactive;		//active particles summed over the block steps
+  
+  real_type *_far_x, *_far_y, *_far_z;	//RESPA far accelerations
+  
+  real_type *_save;		//state before the step, restored if it is rejected
+  
+  int       *_id;		//original index of every particle
+  void      *_scratch;		//one array of doubles for the permutations
+  int        _nreject;		//rejected steps
+  
+  real_type *_tbuf;		//per-thread accelerations of the symmetric kernel
+  int        _tbuf_stride;	//floats per thread and per component
   
   int       _npart;		//number of particles
+  int       _npad;		//number of particles with the zero mass ghosts
+  int       _ntracers;		//massless tracers, stored after the massive particles
   int	    _nsteps;		//number of integration steps
   real_type _tstep;		//time step of the simulation
 
@@ -57,15 +221,123 @@ private:
   
   double _totTime;		//total time of the simulation
   double _totFlops;		//total number of flops 
+  
+  ForceMode _mode;		//force computation
+  KernelKind _kernel;		//inner loop of the direct sum
+  Integrator _integrator;	//time integration scheme
+  real_type _eta;		//accuracy of the block time step criterion
+  int       _nsub;		//RESPA near steps per far step
+  real_type _rcut;		//cutoff of the RESPA near field and of the cutoff modes
+  real_type _skin;		//extra radius of the Verlet lists
+  std::string _isa;		//instruction set of the kernels, empty for the best
+  int       _itile;		//i particles of a register tile, 0 to tune
+  int       _jtile;		//j particles of a cache tile, 0 to tune
+  bool      _tuned;		//tiles chosen by tune_tiles()
+  bool      _fused;		//direct sum fused with the update
+  bool      _lowmem;		//no acceleration arrays, kick in the direct sum
+  bool      _packed;		//direct sum streaming packed {x, y, z, G m} quads
+  real_type _theta;		//Barnes-Hut opening angle
+  int       _order;		//FMM expansion order
+  int       _ngrid;		//PM grid points per dimension
+  real_type _rsplit;		//TreePM split radius, 0 for the default
+  real_type _alpha;		//Ewald split parameter
+  int       _kmax;		//Ewald largest k-vector, in units of 2 pi
+  bool      _layout;		//benchmark the particle layouts instead of the run
+  int       _reorder;		//steps between two sorts along the curve, 0 for none
+  CurveKind _curve;		//space filling curve of the sort
+  std::string _output;		//file of the final state, empty for none
+  std::string _pages;		//arena of the particles: thp or hugetlb, empty for none
+  bool      _check;		//compare with the direct sum on sample steps
+  real_type _adaptive;		//accuracy of the adaptive time step, 0 for a fixed one
+  real_type _reject;		//energy error of a step above which it is rejected, 0 for none
+  double    _tend;		//simulated time of an adaptive run, 0 for nsteps dt
+  double    _ninter;		//interactions evaluated since the last sample
    
   void init_pos();	
   void init_vel();
   void init_acc();
   void init_mass();
+  void init_ghosts();
+  
+  double compute_forces(double *epot = NULL);
+  double block_step(double t_end);
+  double respa_step(real_type dt, bool kinetic, real_type &energy);
+  
+  // the integrators with prediction, acceleration and jerk
+  inline bool hermite() const
+  {
+    return get_integrator() == INTEGRATOR_HERMITE || get_integrator() == INTEGRATOR_BLOCK;
+  }
+  void tune_tiles();
+  void layout_benchmark();
+  void reorder();
+  void write_output() const;
+  real_type *alloc_field(int np);
+  void free_field(real_type *p);
+  
+  // the fused step needs the pragma direct sum and the Euler update
+  inline bool fused_step() const
+  {
+    return get_fused() && get_force_mode() == FORCE_DIRECT && get_kernel() == KERNEL_PRAGMA
+           && get_integrator() == INTEGRATOR_EULER && !lowmem_step();
+  }
+  
+  // so does the low memory step, which keeps no accelerations
+  inline bool lowmem_step() const
+  {
+    return get_lowmem() && get_force_mode() == FORCE_DIRECT && get_kernel() == KERNEL_PRAGMA
+           && get_integrator() == INTEGRATOR_EULER && !get_layout();
+  }
+  
+  // the modes with periodic images of the unit box
+  inline bool periodic() const
+  {
+    return get_force_mode() == FORCE_PM || get_force_mode() == FORCE_TREEPM
+           || get_force_mode() == FORCE_EWALD;
+  }
+  
+  // the total energy is that of the isolated system: not for periodic modes
+  // and the cutoff ones
+  inline bool has_energy() const
+  {
+    return !periodic() && get_force_mode() != FORCE_CUTOFF && get_force_mode() != FORCE_VERLET;
+  }
+  double check_accuracy();
+  
+  // the force kernel gives the potential energy of the positions at the end
+  // of the step, paired with the new velocities: the pragma direct sum with
+  // leapfrog, whose forces come after the drift. The Euler forces are those
+  // of the positions before the update, so Euler takes the separate pass
+  // after it, as the other modes do
+  inline bool kernel_potential() const
+  {
+    return get_force_mode() == FORCE_DIRECT && get_kernel() == KERNEL_PRAGMA
+           && get_integrator() == INTEGRATOR_LEAPFROG;
+  }
+  
+  // a global time step from the largest acceleration, not for block and
+  // multiple time steps
+  inline bool adaptive() const
+  {
+    return get_adaptive() > 0 && get_integrator() != INTEGRATOR_BLOCK
+           && get_integrator() != INTEGRATOR_RESPA;
+  }
+  void save_state();
+  void restore_state();
     
   inline void set_npart(const int &N){ _npart = N; }
   inline int get_npart() const {return _npart; }
   
+  inline void set_npad(const int &N){ _npad = N; }
+  inline int get_npad() const {return _npad; }
+  
+  // the massive particles come first, then the tracers and the ghosts
+  inline int get_nmassive() const {return _npart - _ntracers; }
+  
+  // j range of the direct sum: only the massive particles if there are
+  // tracers, otherwise the padded arrays
+  inline int get_nsources() const {return (_ntracers > 0) ? get_nmassive() : _npad; }
+  
   inline void set_tstep(const real_type &dt){ _tstep = dt; }
   inline real_type get_tstep() const {return _tstep; }
   
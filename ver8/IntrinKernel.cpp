@@ -0,0 +1,213 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <immintrin.h>
+
+#include "IntrinKernel.hpp"
+
+static const int iblock = 4;		//i particles kept in registers
+
+#if defined(__AVX512F__)
+
+static const int width = 16;
+
+// 1/sqrt(x): 14 bit estimate and one Newton-Raphson step, y (3 - x y^2) / 2
+static inline __m512 rsqrt_nr(__m512 x)
+{
+  const __m512 y = _mm512_rsqrt14_ps(x);
+  const __m512 s = _mm512_fnmadd_ps(_mm512_mul_ps(x, y), y, _mm512_set1_ps(3.0f));
+  return _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), y), s);
+}
+
+double KERNEL_NAME(direct_forces_intrin)(ParticleSoA *particles, int n, int nj,
+                                         real_type G, real_type softeningSquared)
+{
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+  const real_type *pm = particles->mass;
+  const __m512 eps2 = _mm512_set1_ps(softeningSquared);
+  const __m512 g = _mm512_set1_ps(G);
+  // the j particles after the first nj have no mass: whole vectors of them
+  // are skipped
+  const int njw = (nj + width - 1) / width * width;
+
+#pragma omp parallel for schedule(static)
+  for (int ii = 0; ii < n; ii += iblock)
+  {
+    __m512 xi[iblock], yi[iblock], zi[iblock];
+    __m512 ax[iblock], ay[iblock], az[iblock];
+    for (int k = 0; k < iblock; ++k)
+    {
+      const int i = ii + k;
+      xi[k] = _mm512_set1_ps(px[i]);
+      yi[k] = _mm512_set1_ps(py[i]);
+      zi[k] = _mm512_set1_ps(pz[i]);
+      ax[k] = _mm512_setzero_ps();
+      ay[k] = _mm512_setzero_ps();
+      az[k] = _mm512_setzero_ps();
+    }
+
+    for (int j = 0; j < njw; j += width)
+    {
+      const __m512 xj = _mm512_loadu_ps(px + j);
+      const __m512 yj = _mm512_loadu_ps(py + j);
+      const __m512 zj = _mm512_loadu_ps(pz + j);
+      const __m512 mj = _mm512_mul_ps(g, _mm512_loadu_ps(pm + j));
+      for (int k = 0; k < iblock; ++k)
+      {
+        const __m512 dx = _mm512_sub_ps(xj, xi[k]);
+        const __m512 dy = _mm512_sub_ps(yj, yi[k]);
+        const __m512 dz = _mm512_sub_ps(zj, zi[k]);
+        const __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, eps2)));
+        const __m512 rinv = rsqrt_nr(r2);
+        const __m512 s = _mm512_mul_ps(_mm512_mul_ps(mj, rinv), _mm512_mul_ps(rinv, rinv));
+        ax[k] = _mm512_fmadd_ps(dx, s, ax[k]);
+        ay[k] = _mm512_fmadd_ps(dy, s, ay[k]);
+        az[k] = _mm512_fmadd_ps(dz, s, az[k]);
+      }
+    }
+
+    for (int k = 0; k < iblock; ++k)
+    {
+      particles->acc_x[ii + k] = _mm512_reduce_add_ps(ax[k]);
+      particles->acc_y[ii + k] = _mm512_reduce_add_ps(ay[k]);
+      particles->acc_z[ii + k] = _mm512_reduce_add_ps(az[k]);
+    }
+  }
+  return double(n) * double(nj);
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+static const int width = 8;
+
+// 1/sqrt(x): 12 bit estimate and one Newton-Raphson step, y (3 - x y^2) / 2
+static inline __m256 rsqrt_nr(__m256 x)
+{
+  const __m256 y = _mm256_rsqrt_ps(x);
+  const __m256 s = _mm256_fnmadd_ps(_mm256_mul_ps(x, y), y, _mm256_set1_ps(3.0f));
+  return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), y), s);
+}
+
+static inline float reduce_add(__m256 v)
+{
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+double KERNEL_NAME(direct_forces_intrin)(ParticleSoA *particles, int n, int nj,
+                                         real_type G, real_type softeningSquared)
+{
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+  const real_type *pm = particles->mass;
+  const __m256 eps2 = _mm256_set1_ps(softeningSquared);
+  const __m256 g = _mm256_set1_ps(G);
+  // the j particles after the first nj have no mass: whole vectors of them
+  // are skipped
+  const int njw = (nj + width - 1) / width * width;
+
+#pragma omp parallel for schedule(static)
+  for (int ii = 0; ii < n; ii += iblock)
+  {
+    __m256 xi[iblock], yi[iblock], zi[iblock];
+    __m256 ax[iblock], ay[iblock], az[iblock];
+    for (int k = 0; k < iblock; ++k)
+    {
+      const int i = ii + k;
+      xi[k] = _mm256_set1_ps(px[i]);
+      yi[k] = _mm256_set1_ps(py[i]);
+      zi[k] = _mm256_set1_ps(pz[i]);
+      ax[k] = _mm256_setzero_ps();
+      ay[k] = _mm256_setzero_ps();
+      az[k] = _mm256_setzero_ps();
+    }
+
+    for (int j = 0; j < njw; j += width)
+    {
+      const __m256 xj = _mm256_loadu_ps(px + j);
+      const __m256 yj = _mm256_loadu_ps(py + j);
+      const __m256 zj = _mm256_loadu_ps(pz + j);
+      const __m256 mj = _mm256_mul_ps(g, _mm256_loadu_ps(pm + j));
+      for (int k = 0; k < iblock; ++k)
+      {
+        const __m256 dx = _mm256_sub_ps(xj, xi[k]);
+        const __m256 dy = _mm256_sub_ps(yj, yi[k]);
+        const __m256 dz = _mm256_sub_ps(zj, zi[k]);
+        const __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps2)));
+        const __m256 rinv = rsqrt_nr(r2);
+        const __m256 s = _mm256_mul_ps(_mm256_mul_ps(mj, rinv), _mm256_mul_ps(rinv, rinv));
+        ax[k] = _mm256_fmadd_ps(dx, s, ax[k]);
+        ay[k] = _mm256_fmadd_ps(dy, s, ay[k]);
+        az[k] = _mm256_fmadd_ps(dz, s, az[k]);
+      }
+    }
+
+    for (int k = 0; k < iblock; ++k)
+    {
+      particles->acc_x[ii + k] = reduce_add(ax[k]);
+      particles->acc_y[ii + k] = reduce_add(ay[k]);
+      particles->acc_z[ii + k] = reduce_add(az[k]);
+    }
+  }
+  return double(n) * double(nj);
+}
+
+#else
+
+double KERNEL_NAME(direct_forces_intrin)(ParticleSoA *particles, int n, int nj,
+                                         real_type G, real_type softeningSquared)
+{
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+  const real_type *pm = particles->mass;
+
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type xi = px[i], yi = py[i], zi = pz[i];
+    real_type ax = 0.0f, ay = 0.0f, az = 0.0f;
+#pragma omp simd reduction(+:ax,ay,az)
+    for (int j = 0; j < nj; ++j)
+    {
+      real_type dx = px[j] - xi;
+      real_type dy = py[j] - yi;
+      real_type dz = pz[j] - zi;
+      real_type distanceInv = 1.0f / sqrtf(dx*dx + dy*dy + dz*dz + softeningSquared);
+      real_type f = G * pm[j] * distanceInv * distanceInv * distanceInv;
+      ax += dx * f;
+      ay += dy * f;
+      az += dz * f;
+    }
+    particles->acc_x[i] = ax;
+    particles->acc_y[i] = ay;
+    particles->acc_z[i] = az;
+  }
+  return double(n) * double(nj);
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _INTRINKERNEL_HPP
+#define _INTRINKERNEL_HPP
+
+#include "Kernels.hpp"
+
+// Direct sum written with explicit intrinsics, so that the inner loop does
+// not depend on the auto-vectorizer of the compiler. Four i particles are
+// broadcast into registers and j is streamed one vector at a time; the
+// inverse distance is rsqrt followed by one Newton-Raphson step.
+// The code path follows the instruction set of the build (see Kernels.hpp):
+// AVX-512, AVX2 with FMA, or a plain simd loop otherwise.
+
+// Compute the accelerations of all particles, n a multiple of 16, from the
+// first nj ones, the only ones with mass; return the number of pair
+// interactions evaluated
+double KERNEL_NAME(direct_forces_intrin)(ParticleSoA *particles, int n, int nj,
+                                         real_type G, real_type softeningSquared);
+
+#endif
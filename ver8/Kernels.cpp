@@ -0,0 +1,1234 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <omp.h>
+
+#include "Kernels.hpp"
+#include "IntrinKernel.hpp"
+
+// This file is compiled once per instruction set, with KERNEL_ISA set to
+// the suffix of the exported names. Inline functions of other headers are
+// instantiated in every build and only one copy survives the link, so the
+// kernels use none: a copy built for AVX-512 could end up called on a CPU
+// without it.
+#ifndef KERNEL_ISA
+#error "KERNEL_ISA must be defined"
+#endif
+
+static const int alignment = 32;
+
+// Two level blocking: a tile of T i particles is kept in registers and j
+// is streamed in chunks of jtile particles, small enough to stay in cache
+// while all the i tiles of the thread go over it. The partial sums are kept
+// in the acceleration arrays between chunks: with the same static schedule
+// every thread sees the same i tiles in every chunk, so no barrier is needed.
+// With POT the sum of m_i m_j / r over the pairs, self terms included, is
+// accumulated from the same distanceInv and returned.
+// With PACKED the j particles are read from jbuf, quads {x, y, z, G m}
+// built by pack_sources: one stream instead of four, and G m_j is not
+// recomputed for every pair.
+template<int T, bool POT, bool PACKED>
+static double direct_tiles(ParticleSoA *particles, int n, real_type G, real_type softeningSquared,
+                           int ni, int jtile, const real_type *jbuf)
+{
+  const int ntiles = ni / T;
+  double pot = 0.;
+
+  __assume_aligned(particles->pos_x, alignment);
+  __assume_aligned(particles->pos_y, alignment);
+  __assume_aligned(particles->pos_z, alignment);
+  __assume_aligned(particles->acc_x, alignment);
+  __assume_aligned(particles->acc_y, alignment);
+  __assume_aligned(particles->acc_z, alignment);
+  __assume_aligned(particles->mass, alignment);
+
+#pragma omp parallel reduction(+:pot)
+  for (int jj = 0; jj < n; jj += jtile)
+  {
+    const int jend = (jj + jtile < n) ? jj + jtile : n;
+
+#pragma omp for schedule(static) nowait
+    for (int t = 0; t < ntiles; ++t)
+    {
+      const int ii = t * T;
+      real_type xi[T], yi[T], zi[T];
+      real_type acc_xtile[T], acc_ytile[T], acc_ztile[T];
+      real_type phi_tile[T];
+      for (int s = 0; s < T; s++)
+      {
+        const int i = ii + s;
+        xi[s] = particles->pos_x[i];
+        yi[s] = particles->pos_y[i];
+        zi[s] = particles->pos_z[i];
+        acc_xtile[s] = (jj > 0) ? particles->acc_x[i] : 0.0f;
+        acc_ytile[s] = (jj > 0) ? particles->acc_y[i] : 0.0f;
+        acc_ztile[s] = (jj > 0) ? particles->acc_z[i] : 0.0f;
+        phi_tile[s] = 0.0f;
+      }
+
+      if(PACKED)
+      {
+        #pragma omp simd
+        for (int j = jj; j < jend; j++)
+        {
+          for (int s = 0; s < T; s++)
+          {
+            real_type dx = jbuf[4*j]     - xi[s];				//1flop
+            real_type dy = jbuf[4*j + 1] - yi[s];				//1flop
+            real_type dz = jbuf[4*j + 2] - zi[s];				//1flop
+
+            real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared; //6flops
+            real_type distanceInv = 1.0f / sqrtf(distanceSqr);		//1div+1sqrt
+
+            real_type gmr = jbuf[4*j + 3] * distanceInv;			//1flop
+            real_type f = gmr * distanceInv * distanceInv;			//2flops
+            acc_xtile[s] += dx * f;						//2flops
+            acc_ytile[s] += dy * f;						//2flops
+            acc_ztile[s] += dz * f;						//2flops
+            if(POT)
+              phi_tile[s] += gmr;						//1flop
+          }
+        }
+      }
+      else
+      {
+        #pragma omp simd
+        for (int j = jj; j < jend; j++)
+        {
+          for (int s = 0; s < T; s++)
+          {
+            real_type dx, dy, dz;
+            real_type distanceSqr = 0.0f;
+            real_type distanceInv = 0.0f;
+
+            dx = particles->pos_x[j] - xi[s];				//1flop
+            dy = particles->pos_y[j] - yi[s];				//1flop
+            dz = particles->pos_z[j] - zi[s];				//1flop
+
+            distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
+            distanceInv = 1.0f / sqrtf(distanceSqr);			//1div+1sqrt
+
+            acc_xtile[s] += dx * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
+            acc_ytile[s] += dy * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
+            acc_ztile[s] += dz * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
+            if(POT)
+              phi_tile[s] += particles->mass[j] * distanceInv;		//2flops
+          }
+        }
+      }
+
+      for (int s = 0; s < T; s++)
+      {
+        particles->acc_x[ii + s] = acc_xtile[s];
+        particles->acc_y[ii + s] = acc_ytile[s];
+        particles->acc_z[ii + s] = acc_ztile[s];
+        if(POT)
+          pot += (double) particles->mass[ii + s] * (double) phi_tile[s];
+      }
+    }
+  }
+  // the packed sum has G in it
+  return PACKED ? pot / G : pot;
+}
+
+// The quads {x, y, z, G m} of the first n particles, in one parallel pass
+static void pack_sources(const ParticleSoA *particles, int n, real_type G, real_type *jbuf)
+{
+#pragma omp parallel for schedule(static)
+  for (int j = 0; j < n; ++j)
+  {
+    jbuf[4*j]     = particles->pos_x[j];
+    jbuf[4*j + 1] = particles->pos_y[j];
+    jbuf[4*j + 2] = particles->pos_z[j];
+    jbuf[4*j + 3] = G * particles->mass[j];
+  }
+}
+
+template<bool POT, bool PACKED>
+static double direct_itile(ParticleSoA *particles, int n, real_type G, real_type softeningSquared,
+                           int ni, int itile, int jtile, const real_type *jbuf)
+{
+  switch(itile)
+  {
+    case 2:  return direct_tiles<2,POT,PACKED>(particles, n, G, softeningSquared, ni, jtile, jbuf);
+    case 4:  return direct_tiles<4,POT,PACKED>(particles, n, G, softeningSquared, ni, jtile, jbuf);
+    case 16: return direct_tiles<16,POT,PACKED>(particles, n, G, softeningSquared, ni, jtile, jbuf);
+    case 8:
+    default: return direct_tiles<8,POT,PACKED>(particles, n, G, softeningSquared, ni, jtile, jbuf);
+  }
+}
+
+// Potential energy -1/2 G (pot - sum_i m_i^2 / eps) of the n particles from
+// the pair sum pot of the kernels, taking out the self terms
+static double potential_from_sum(const ParticleSoA *particles, int n, real_type G,
+                                 real_type softeningSquared, double pot)
+{
+  double self = 0.;
+  for (int i = 0; i < n; ++i)
+    self += (double) particles->mass[i] * (double) particles->mass[i];
+  return -0.5 * G * (pot - self / sqrtf(softeningSquared));
+}
+
+// The potential energy is computed only if epot is given; the j particles
+// are packed into jbuf first if it is given
+static double direct_pragma(ParticleSoA *particles, int n, real_type G, real_type softeningSquared,
+                            int ni, int itile, int jtile, double *epot, real_type *jbuf)
+{
+  if(jbuf != NULL)
+    pack_sources(particles, n, G, jbuf);
+  if(epot != NULL)
+  {
+    const double pot = (jbuf != NULL)
+      ? direct_itile<true,true>(particles, n, G, softeningSquared, ni, itile, jtile, jbuf)
+      : direct_itile<true,false>(particles, n, G, softeningSquared, ni, itile, jtile, jbuf);
+    *epot = potential_from_sum(particles, ni, G, softeningSquared, pot);
+  }
+  else if(jbuf != NULL)
+    direct_itile<false,true>(particles, n, G, softeningSquared, ni, itile, jtile, jbuf);
+  else
+    direct_itile<false,false>(particles, n, G, softeningSquared, ni, itile, jtile, jbuf);
+  return double(ni) * double(n);
+}
+
+// Direct sum applied straight to the velocities, for the low memory mode:
+// every thread takes blocks of kick_block i particles and keeps their
+// accelerations in a buffer on its stack while the j chunks of jtile
+// particles go over all the i tiles of the block, then kicks their
+// velocities and drops the accelerations. The positions are only read, so
+// the drift is a separate pass.
+static const int kick_block = 256;
+
+template<int T>
+static void kick_tiles(ParticleSoA *particles, int n, real_type G, real_type softeningSquared,
+                       int ni, int jtile, real_type dt, real_type &amax2)
+{
+  const int B = kick_block;
+  const int nblocks = (ni + B - 1) / B;
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+  const real_type *pm = particles->mass;
+  real_type a2max = 0;
+
+#pragma omp parallel for schedule(static) reduction(max:a2max)
+  for (int b = 0; b < nblocks; ++b)
+  {
+    const int i0 = b * B;
+    const int iend = (i0 + B < ni) ? i0 + B : ni;
+    real_type bx[B], by[B], bz[B];
+    for (int i = 0; i < B; ++i)
+      bx[i] = by[i] = bz[i] = 0.0f;
+
+    for (int jj = 0; jj < n; jj += jtile)
+    {
+      const int jend = (jj + jtile < n) ? jj + jtile : n;
+      for (int ii = i0; ii < iend; ii += T)
+      {
+        real_type xi[T], yi[T], zi[T];
+        real_type acc_xtile[T], acc_ytile[T], acc_ztile[T];
+        for (int s = 0; s < T; s++)
+        {
+          xi[s] = px[ii + s];
+          yi[s] = py[ii + s];
+          zi[s] = pz[ii + s];
+          acc_xtile[s] = bx[ii - i0 + s];
+          acc_ytile[s] = by[ii - i0 + s];
+          acc_ztile[s] = bz[ii - i0 + s];
+        }
+
+        #pragma omp simd
+        for (int j = jj; j < jend; j++)
+        {
+          for (int s = 0; s < T; s++)
+          {
+            real_type dx = px[j] - xi[s];					//1flop
+            real_type dy = py[j] - yi[s];					//1flop
+            real_type dz = pz[j] - zi[s];					//1flop
+
+            real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared; //6flops
+            real_type distanceInv = 1.0f / sqrtf(distanceSqr);		//1div+1sqrt
+
+            real_type mr = pm[j] * distanceInv;				//1flop
+            real_type f = G * mr * distanceInv * distanceInv;		//3flops
+            acc_xtile[s] += dx * f;						//2flops
+            acc_ytile[s] += dy * f;						//2flops
+            acc_ztile[s] += dz * f;						//2flops
+          }
+        }
+
+        for (int s = 0; s < T; s++)
+        {
+          bx[ii - i0 + s] = acc_xtile[s];
+          by[ii - i0 + s] = acc_ytile[s];
+          bz[ii - i0 + s] = acc_ztile[s];
+        }
+      }
+    }
+
+    for (int i = i0; i < iend; ++i)
+    {
+      const real_type ax = bx[i - i0], ay = by[i - i0], az = bz[i - i0];
+      const real_type a2 = ax*ax + ay*ay + az*az;
+      a2max = (a2 > a2max) ? a2 : a2max;
+      particles->vel_x[i] += ax * dt;					//2flops
+      particles->vel_y[i] += ay * dt;					//2flops
+      particles->vel_z[i] += az * dt;					//2flops
+    }
+  }
+  amax2 = a2max;
+}
+
+static double direct_kick(ParticleSoA *particles, int n, real_type G, real_type softeningSquared,
+                          int ni, int itile, int jtile, real_type dt, real_type &amax2)
+{
+  switch(itile)
+  {
+    case 2:  kick_tiles<2>(particles, n, G, softeningSquared, ni, jtile, dt, amax2); break;
+    case 4:  kick_tiles<4>(particles, n, G, softeningSquared, ni, jtile, dt, amax2); break;
+    case 16: kick_tiles<16>(particles, n, G, softeningSquared, ni, jtile, dt, amax2); break;
+    case 8:
+    default: kick_tiles<8>(particles, n, G, softeningSquared, ni, jtile, dt, amax2); break;
+  }
+  return double(ni) * double(n);
+}
+
+// Drift of the low memory step, after direct_kick
+static real_type drift(ParticleSoA *particles, int n, real_type dt, bool kinetic)
+{
+  real_type energy = 0;
+#pragma omp parallel for reduction(+:energy)
+  for (int i = 0; i < n; ++i)
+  {
+    particles->pos_x[i] += particles->vel_x[i] * dt; //2flops
+    particles->pos_y[i] += particles->vel_y[i] * dt; //2flops
+    particles->pos_z[i] += particles->vel_z[i] * dt; //2flops
+
+    if(kinetic)
+      energy += particles->mass[i] * (
+                particles->vel_x[i]*particles->vel_x[i] +
+                particles->vel_y[i]*particles->vel_y[i] +
+                particles->vel_z[i]*particles->vel_z[i]); //7flops
+  }
+  return energy;
+}
+
+// One pair of the symmetric kernel: the action of j is added to the
+// accumulators of i and the reaction of i to the accumulators of j
+static inline void symmetric_pair(real_type xj, real_type yj, real_type zj, real_type mj,
+                                  real_type xi, real_type yi, real_type zi, real_type mi,
+                                  real_type &ax_i, real_type &ay_i, real_type &az_i,
+                                  real_type &ax_j, real_type &ay_j, real_type &az_j,
+                                  real_type softeningSquared)
+{
+  real_type dx = xj - xi;						//1flop
+  real_type dy = yj - yi;						//1flop
+  real_type dz = zj - zi;						//1flop
+
+  real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
+  real_type distanceInv = 1.0f / sqrtf(distanceSqr);			//1div+1sqrt
+  real_type s = distanceInv * distanceInv * distanceInv;		//2flops
+
+  real_type fj = mj * s;						//1flop
+  ax_i += dx * fj;							//2flops
+  ay_i += dy * fj;							//2flops
+  az_i += dz * fj;							//2flops
+
+  real_type fi = mi * s;						//1flop
+  ax_j -= dx * fi;							//2flops
+  ay_j -= dy * fi;							//2flops
+  az_j -= dz * fi;							//2flops
+}
+
+// Newton's third law: every pair is evaluated once, the reaction on j is
+// scattered into a private buffer of the thread and the buffers are summed
+// at the end, so no two threads ever write the same location. Four i are
+// kept in registers, so that j is loaded and stored once for four pairs.
+// The tiles stop after the first nj particles: the pairs of two particles
+// without mass are zero.
+static double symmetric(ParticleSoA *particles, int n, int nj, real_type G,
+                        real_type softeningSquared, real_type *tbuf, int stride)
+{
+  const int tileSize = 4;
+  const int ni = (nj + tileSize - 1) / tileSize * tileSize;
+
+#pragma omp parallel
+  {
+    const int t = omp_get_thread_num();
+    real_type *bx = tbuf + (3*t + 0) * stride;
+    real_type *by = tbuf + (3*t + 1) * stride;
+    real_type *bz = tbuf + (3*t + 2) * stride;
+    const real_type *px = particles->pos_x;
+    const real_type *py = particles->pos_y;
+    const real_type *pz = particles->pos_z;
+    const real_type *pm = particles->mass;
+    #pragma omp simd
+    for (int j = 0; j < n; ++j)
+    {
+      bx[j] = 0.0f;
+      by[j] = 0.0f;
+      bz[j] = 0.0f;
+    }
+
+    // tile ii costs n-ii pairs: dynamic scheduling balances the triangle
+#pragma omp for schedule(dynamic,1)
+    for (int ii = 0; ii < ni; ii += tileSize)
+    {
+      const int iend = ii + tileSize;
+
+      // pairs inside the tile
+      for (int i = ii; i < iend; ++i)
+        for (int j = i + 1; j < iend; ++j)
+          symmetric_pair(px[j], py[j], pz[j], G * pm[j], px[i], py[i], pz[i], G * pm[i],
+                         bx[i], by[i], bz[i], bx[j], by[j], bz[j], softeningSquared);
+
+      // pairs with the particles after the tile
+      const real_type x0 = px[ii], x1 = px[ii+1], x2 = px[ii+2], x3 = px[ii+3];
+      const real_type y0 = py[ii], y1 = py[ii+1], y2 = py[ii+2], y3 = py[ii+3];
+      const real_type z0 = pz[ii], z1 = pz[ii+1], z2 = pz[ii+2], z3 = pz[ii+3];
+      const real_type m0 = G * pm[ii],   m1 = G * pm[ii+1];
+      const real_type m2 = G * pm[ii+2], m3 = G * pm[ii+3];
+      real_type ax0 = 0.0f, ax1 = 0.0f, ax2 = 0.0f, ax3 = 0.0f;
+      real_type ay0 = 0.0f, ay1 = 0.0f, ay2 = 0.0f, ay3 = 0.0f;
+      real_type az0 = 0.0f, az1 = 0.0f, az2 = 0.0f, az3 = 0.0f;
+      #pragma omp simd reduction(+:ax0,ax1,ax2,ax3,ay0,ay1,ay2,ay3,az0,az1,az2,az3)
+      for (int j = iend; j < n; ++j)
+      {
+        const real_type xj = px[j], yj = py[j], zj = pz[j], mj = G * pm[j];
+        real_type ax_j = 0.0f, ay_j = 0.0f, az_j = 0.0f;
+        symmetric_pair(xj, yj, zj, mj, x0, y0, z0, m0, ax0, ay0, az0, ax_j, ay_j, az_j,
+                       softeningSquared);
+        symmetric_pair(xj, yj, zj, mj, x1, y1, z1, m1, ax1, ay1, az1, ax_j, ay_j, az_j,
+                       softeningSquared);
+        symmetric_pair(xj, yj, zj, mj, x2, y2, z2, m2, ax2, ay2, az2, ax_j, ay_j, az_j,
+                       softeningSquared);
+        symmetric_pair(xj, yj, zj, mj, x3, y3, z3, m3, ax3, ay3, az3, ax_j, ay_j, az_j,
+                       softeningSquared);
+        bx[j] += ax_j;
+        by[j] += ay_j;
+        bz[j] += az_j;
+      }
+      bx[ii] += ax0; bx[ii+1] += ax1; bx[ii+2] += ax2; bx[ii+3] += ax3;
+      by[ii] += ay0; by[ii+1] += ay1; by[ii+2] += ay2; by[ii+3] += ay3;
+      bz[ii] += az0; bz[ii+1] += az1; bz[ii+2] += az2; bz[ii+3] += az3;
+    }
+
+    const int nthreads = omp_get_num_threads();
+#pragma omp for
+    for (int i = 0; i < n; ++i)
+    {
+      real_type ax = 0.0f, ay = 0.0f, az = 0.0f;
+      for (int k = 0; k < nthreads; ++k)
+      {
+        ax += tbuf[(3*k + 0) * stride + i];
+        ay += tbuf[(3*k + 1) * stride + i];
+        az += tbuf[(3*k + 2) * stride + i];
+      }
+      particles->acc_x[i] = ax;
+      particles->acc_y[i] = ay;
+      particles->acc_z[i] = az;
+    }
+  }
+  return 0.5 * double(ni) * double(ni - 1) + double(ni) * double(n - ni);
+}
+
+static real_type update(ParticleSoA *particles, int n, real_type dt, bool kinetic,
+                        real_type &amax2)
+{
+  real_type energy = 0;
+  real_type a2max = 0;
+#pragma omp parallel for reduction(+:energy) reduction(max:a2max)
+  for (int i = 0; i < n; ++i)// update position
+  {
+    const real_type a2 = particles->acc_x[i]*particles->acc_x[i] +
+                         particles->acc_y[i]*particles->acc_y[i] +
+                         particles->acc_z[i]*particles->acc_z[i];
+    a2max = (a2 > a2max) ? a2 : a2max;
+
+    particles->vel_x[i] += particles->acc_x[i] * dt; //2flops
+    particles->vel_y[i] += particles->acc_y[i] * dt; //2flops
+    particles->vel_z[i] += particles->acc_z[i] * dt; //2flops
+	  
+    particles->pos_x[i] += particles->vel_x[i] * dt; //2flops
+    particles->pos_y[i] += particles->vel_y[i] * dt; //2flops
+    particles->pos_z[i] += particles->vel_z[i] * dt; //2flops
+
+    particles->acc_x[i] = 0.;
+    particles->acc_y[i] = 0.;
+    particles->acc_z[i] = 0.;
+	
+    if(kinetic)
+      energy += particles->mass[i] * (
+                particles->vel_x[i]*particles->vel_x[i] +
+                particles->vel_y[i]*particles->vel_y[i] +
+                particles->vel_z[i]*particles->vel_z[i]); //7flops
+  }
+  amax2 = a2max;
+  return energy;
+}
+
+// Leapfrog: half kick with the old accelerations and drift
+static void kick_drift(ParticleSoA *particles, int n, real_type dt)
+{
+  const real_type hdt = 0.5f * dt;
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    particles->vel_x[i] += particles->acc_x[i] * hdt; //2flops
+    particles->vel_y[i] += particles->acc_y[i] * hdt; //2flops
+    particles->vel_z[i] += particles->acc_z[i] * hdt; //2flops
+
+    particles->pos_x[i] += particles->vel_x[i] * dt; //2flops
+    particles->pos_y[i] += particles->vel_y[i] * dt; //2flops
+    particles->pos_z[i] += particles->vel_z[i] * dt; //2flops
+  }
+}
+
+// Leapfrog: half kick with the new accelerations
+static real_type kick(ParticleSoA *particles, int n, real_type dt, bool kinetic,
+                      real_type &amax2)
+{
+  const real_type hdt = 0.5f * dt;
+  real_type energy = 0;
+  real_type a2max = 0;
+#pragma omp parallel for reduction(+:energy) reduction(max:a2max)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type a2 = particles->acc_x[i]*particles->acc_x[i] +
+                         particles->acc_y[i]*particles->acc_y[i] +
+                         particles->acc_z[i]*particles->acc_z[i];
+    a2max = (a2 > a2max) ? a2 : a2max;
+
+    particles->vel_x[i] += particles->acc_x[i] * hdt; //2flops
+    particles->vel_y[i] += particles->acc_y[i] * hdt; //2flops
+    particles->vel_z[i] += particles->acc_z[i] * hdt; //2flops
+
+    if(kinetic)
+      energy += particles->mass[i] * (
+                particles->vel_x[i]*particles->vel_x[i] +
+                particles->vel_y[i]*particles->vel_y[i] +
+                particles->vel_z[i]*particles->vel_z[i]); //7flops
+  }
+  amax2 = a2max;
+  return energy;
+}
+
+// Hermite predictor, to third order in the old acceleration and jerk
+static void predict(ParticleSoA *particles, int np, real_type dt)
+{
+  const real_type dt2 = dt * dt / 2.0f;
+  const real_type dt3 = dt * dt * dt / 6.0f;
+#pragma omp parallel for simd
+  for (int i = 0; i < np; ++i)
+  {
+    particles->ppos_x[i] = particles->pos_x[i] + particles->vel_x[i] * dt
+                         + particles->acc_x[i] * dt2 + particles->jrk_x[i] * dt3;
+    particles->ppos_y[i] = particles->pos_y[i] + particles->vel_y[i] * dt
+                         + particles->acc_y[i] * dt2 + particles->jrk_y[i] * dt3;
+    particles->ppos_z[i] = particles->pos_z[i] + particles->vel_z[i] * dt
+                         + particles->acc_z[i] * dt2 + particles->jrk_z[i] * dt3;
+    particles->pvel_x[i] = particles->vel_x[i] + particles->acc_x[i] * dt + particles->jrk_x[i] * dt2;
+    particles->pvel_y[i] = particles->vel_y[i] + particles->acc_y[i] * dt + particles->jrk_y[i] * dt2;
+    particles->pvel_z[i] = particles->vel_z[i] + particles->acc_z[i] * dt + particles->jrk_z[i] * dt2;
+  }
+}
+
+// Acceleration and jerk on the predicted particle i from all the np
+// predicted particles, in one sweep over j
+static inline void hermite_sum(const ParticleSoA *particles, int np, int i, real_type G,
+                               real_type softeningSquared,
+                               real_type &ax, real_type &ay, real_type &az,
+                               real_type &jx, real_type &jy, real_type &jz)
+{
+  const real_type *px = particles->ppos_x;
+  const real_type *py = particles->ppos_y;
+  const real_type *pz = particles->ppos_z;
+  const real_type *vx = particles->pvel_x;
+  const real_type *vy = particles->pvel_y;
+  const real_type *vz = particles->pvel_z;
+  const real_type *pm = particles->mass;
+  const real_type xi = px[i], yi = py[i], zi = pz[i];
+  const real_type vxi = vx[i], vyi = vy[i], vzi = vz[i];
+  real_type sax = 0.0f, say = 0.0f, saz = 0.0f;
+  real_type sjx = 0.0f, sjy = 0.0f, sjz = 0.0f;
+
+  #pragma omp simd reduction(+:sax,say,saz,sjx,sjy,sjz)
+  for (int j = 0; j < np; j++)
+  {
+    real_type dx  = px[j] - xi;						//1flop
+    real_type dy  = py[j] - yi;						//1flop
+    real_type dz  = pz[j] - zi;						//1flop
+    real_type dvx = vx[j] - vxi;					//1flop
+    real_type dvy = vy[j] - vyi;					//1flop
+    real_type dvz = vz[j] - vzi;					//1flop
+
+    real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
+    real_type distanceInv = 1.0f / sqrtf(distanceSqr);			//1div+1sqrt
+    real_type f  = G * pm[j] * distanceInv * distanceInv * distanceInv;	//4flops
+    real_type rv = 3.0f * (dx*dvx + dy*dvy + dz*dvz) * distanceInv * distanceInv; //8flops
+
+    sax += dx * f;							//2flops
+    say += dy * f;							//2flops
+    saz += dz * f;							//2flops
+    sjx += (dvx - rv * dx) * f;						//4flops
+    sjy += (dvy - rv * dy) * f;						//4flops
+    sjz += (dvz - rv * dz) * f;						//4flops
+  }
+  ax = sax; ay = say; az = saz;
+  jx = sjx; jy = sjy; jz = sjz;
+}
+
+// Hermite corrector of particle i over dt, with the new acceleration and
+// jerk a1, j1; the old ones are replaced
+//   v1 = v0 + (a0 + a1) dt/2 + (j0 - j1) dt^2/12
+//   x1 = x0 + (v0 + v1) dt/2 + (a0 - a1) dt^2/12
+static inline void hermite_correct(ParticleSoA *particles, int i, real_type dt,
+                                   real_type ax, real_type ay, real_type az,
+                                   real_type jx, real_type jy, real_type jz)
+{
+  const real_type dt12 = dt * dt / 12.0f;
+  const real_type vx1 = particles->vel_x[i] + (particles->acc_x[i] + ax) * 0.5f * dt
+                      + (particles->jrk_x[i] - jx) * dt12;
+  const real_type vy1 = particles->vel_y[i] + (particles->acc_y[i] + ay) * 0.5f * dt
+                      + (particles->jrk_y[i] - jy) * dt12;
+  const real_type vz1 = particles->vel_z[i] + (particles->acc_z[i] + az) * 0.5f * dt
+                      + (particles->jrk_z[i] - jz) * dt12;
+  particles->pos_x[i] += (particles->vel_x[i] + vx1) * 0.5f * dt
+                       + (particles->acc_x[i] - ax) * dt12;
+  particles->pos_y[i] += (particles->vel_y[i] + vy1) * 0.5f * dt
+                       + (particles->acc_y[i] - ay) * dt12;
+  particles->pos_z[i] += (particles->vel_z[i] + vz1) * 0.5f * dt
+                       + (particles->acc_z[i] - az) * dt12;
+  particles->vel_x[i] = vx1;
+  particles->vel_y[i] = vy1;
+  particles->vel_z[i] = vz1;
+  particles->acc_x[i] = ax;
+  particles->acc_y[i] = ay;
+  particles->acc_z[i] = az;
+  particles->jrk_x[i] = jx;
+  particles->jrk_y[i] = jy;
+  particles->jrk_z[i] = jz;
+}
+
+// Acceleration and jerk of the predicted particles followed, for the same
+// i, by the corrector. The other threads read only the predicted arrays,
+// so i can be updated in place. Without correct the new acceleration and
+// jerk are only stored, to start the integration.
+static real_type hermite(ParticleSoA *particles, int n, int np, real_type G,
+                         real_type softeningSquared, real_type dt, bool correct,
+                         bool kinetic, real_type &amax2)
+{
+  real_type energy = 0;
+  real_type a2max = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:energy) reduction(max:a2max)
+  for (int i = 0; i < np; ++i)
+  {
+    real_type ax, ay, az, jx, jy, jz;
+    hermite_sum(particles, np, i, G, softeningSquared, ax, ay, az, jx, jy, jz);
+
+    // the ghosts keep no acceleration, so that they are never predicted away
+    if(i >= n)
+      continue;
+    const real_type a2 = ax*ax + ay*ay + az*az;
+    a2max = (a2 > a2max) ? a2 : a2max;
+    if(correct)
+      hermite_correct(particles, i, dt, ax, ay, az, jx, jy, jz);
+    else
+    {
+      particles->acc_x[i] = ax; particles->acc_y[i] = ay; particles->acc_z[i] = az;
+      particles->jrk_x[i] = jx; particles->jrk_y[i] = jy; particles->jrk_z[i] = jz;
+    }
+
+    if(kinetic)
+      energy += particles->mass[i] * (
+                particles->vel_x[i]*particles->vel_x[i] +
+                particles->vel_y[i]*particles->vel_y[i] +
+                particles->vel_z[i]*particles->vel_z[i]);		//7flops
+  }
+  amax2 = a2max;
+  return energy;
+}
+
+// Block time steps: prediction of all np particles to the time t, from the
+// time tlast of their last correction
+static void predict_block(ParticleSoA *particles, int np, double t, const double *tlast)
+{
+#pragma omp parallel for simd
+  for (int i = 0; i < np; ++i)
+  {
+    const real_type dt  = (real_type) (t - tlast[i]);
+    const real_type dt2 = dt * dt / 2.0f;
+    const real_type dt3 = dt * dt * dt / 6.0f;
+    particles->ppos_x[i] = particles->pos_x[i] + particles->vel_x[i] * dt
+                         + particles->acc_x[i] * dt2 + particles->jrk_x[i] * dt3;
+    particles->ppos_y[i] = particles->pos_y[i] + particles->vel_y[i] * dt
+                         + particles->acc_y[i] * dt2 + particles->jrk_y[i] * dt3;
+    particles->ppos_z[i] = particles->pos_z[i] + particles->vel_z[i] * dt
+                         + particles->acc_z[i] * dt2 + particles->jrk_z[i] * dt3;
+    particles->pvel_x[i] = particles->vel_x[i] + particles->acc_x[i] * dt + particles->jrk_x[i] * dt2;
+    particles->pvel_y[i] = particles->vel_y[i] + particles->acc_y[i] * dt + particles->jrk_y[i] * dt2;
+    particles->pvel_z[i] = particles->vel_z[i] + particles->acc_z[i] * dt + particles->jrk_z[i] * dt2;
+  }
+}
+
+// Block time steps: Hermite step of the nact particles of the compact list
+// active, each over its own step dt[i], against all the np predicted
+// particles. The time step criterion of Aarseth, with the second and third
+// derivative of the acceleration at the end of the step,
+//   dt = sqrt(eta (|a| |a2| + |j|^2) / (|j| |a3| + |a2|^2)),
+// is returned in dtcrit for every active particle.
+static void hermite_active(ParticleSoA *particles, int np, real_type G, real_type softeningSquared,
+                           const int *active, int nact, const double *dt, real_type eta,
+                           real_type *dtcrit)
+{
+#pragma omp parallel for schedule(dynamic,16)
+  for (int k = 0; k < nact; ++k)
+  {
+    const int i = active[k];
+    real_type ax, ay, az, jx, jy, jz;
+    hermite_sum(particles, np, i, G, softeningSquared, ax, ay, az, jx, jy, jz);
+
+    const real_type h = (real_type) dt[i];
+    const real_type h2 = h * h;
+    const real_type dax = particles->acc_x[i] - ax, day = particles->acc_y[i] - ay;
+    const real_type daz = particles->acc_z[i] - az;
+    // a2 and a3 at the start of the step, then a2 moved to the end
+    const real_type a3x = (12.0f * dax + 6.0f * h * (particles->jrk_x[i] + jx)) / (h2 * h);
+    const real_type a3y = (12.0f * day + 6.0f * h * (particles->jrk_y[i] + jy)) / (h2 * h);
+    const real_type a3z = (12.0f * daz + 6.0f * h * (particles->jrk_z[i] + jz)) / (h2 * h);
+    const real_type a2x = (-6.0f * dax - h * (4.0f * particles->jrk_x[i] + 2.0f * jx)) / h2 + a3x * h;
+    const real_type a2y = (-6.0f * day - h * (4.0f * particles->jrk_y[i] + 2.0f * jy)) / h2 + a3y * h;
+    const real_type a2z = (-6.0f * daz - h * (4.0f * particles->jrk_z[i] + 2.0f * jz)) / h2 + a3z * h;
+
+    hermite_correct(particles, i, h, ax, ay, az, jx, jy, jz);
+
+    const real_type a  = sqrtf(ax*ax + ay*ay + az*az);
+    const real_type j2 = jx*jx + jy*jy + jz*jz;
+    const real_type s2 = a2x*a2x + a2y*a2y + a2z*a2z;
+    const real_type s3 = sqrtf(a3x*a3x + a3y*a3y + a3z*a3z);
+    dtcrit[k] = sqrtf(eta * (a * sqrtf(s2) + j2) / (sqrtf(j2) * s3 + s2));
+  }
+}
+
+// Potential energy -1/2 sum_i sum_j G m_i m_j / sqrt(r^2 + eps^2): the sum
+// over j includes i itself, whose term is taken out at the end. The inner
+// sums are in single precision, the outer one in double.
+static double potential(ParticleSoA *particles, int n, real_type G, real_type softeningSquared)
+{
+  double energy = 0.;
+#pragma omp parallel for reduction(+:energy)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type xi = particles->pos_x[i];
+    const real_type yi = particles->pos_y[i];
+    const real_type zi = particles->pos_z[i];
+    const real_type *px = particles->pos_x;
+    const real_type *py = particles->pos_y;
+    const real_type *pz = particles->pos_z;
+    const real_type *pm = particles->mass;
+    real_type phi = 0.0f;
+    #pragma omp simd reduction(+:phi)
+    for (int j = 0; j < n; ++j)
+    {
+      real_type dx = px[j] - xi;
+      real_type dy = py[j] - yi;
+      real_type dz = pz[j] - zi;
+      phi += pm[j] / sqrtf(dx*dx + dy*dy + dz*dz + softeningSquared);
+    }
+    phi -= pm[i] / sqrtf(softeningSquared);
+    energy -= 0.5 * G * (double) pm[i] * (double) phi;
+  }
+  return energy;
+}
+
+// RESPA far field: the direct sum over all np particles weighted by
+// 1 - S(r) = x^2 (3 - 2x), x = (r - rin)/(rc - rin) clamped to [0,1],
+// the complement of the switch of the near field in Respa. The pairs
+// closer than rin get a zero weight, but all of them are computed, since
+// the mask costs less than the branch.
+static double respa_far(ParticleSoA *particles, int n, int np, real_type G,
+                        real_type softeningSquared, real_type rin, real_type rc,
+                        real_type *ax, real_type *ay, real_type *az)
+{
+  const real_type invWidth = 1.0f / (rc - rin);
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+  const real_type *pm = particles->mass;
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type xi = px[i];
+    const real_type yi = py[i];
+    const real_type zi = pz[i];
+    real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+    #pragma omp simd reduction(+:ax_i,ay_i,az_i)
+    for (int j = 0; j < np; ++j)
+    {
+      real_type dx = px[j] - xi;					//1flop
+      real_type dy = py[j] - yi;					//1flop
+      real_type dz = pz[j] - zi;					//1flop
+
+      real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
+      real_type distanceInv = 1.0f / sqrtf(distanceSqr);		//1div+1sqrt
+
+      real_type x = (distanceSqr * distanceInv - rin) * invWidth;	//3flops
+      x = (x < 0.0f) ? 0.0f : ((x > 1.0f) ? 1.0f : x);
+      real_type f = G * pm[j] * distanceInv * distanceInv * distanceInv
+                  * x * x * (3.0f - 2.0f * x);				//9flops
+      ax_i += dx * f;							//2flops
+      ay_i += dy * f;							//2flops
+      az_i += dz * f;							//2flops
+    }
+    ax[i] = ax_i;
+    ay[i] = ay_i;
+    az[i] = az_i;
+  }
+  return double(n) * double(np);
+}
+
+// Cutoff force from neighbour lists in CSR form: the neighbours of i are
+// neigh[offset[i]..offset[i+1]), indices into the same arrays, gathered by
+// the SIMD loop. The lists may hold pairs a bit beyond rc, which are masked.
+static double neighbours(const real_type *x, const real_type *y, const real_type *z,
+                         const real_type *m, int n, const int *offset, const int *neigh,
+                         real_type G, real_type softeningSquared, real_type rc,
+                         real_type *ax, real_type *ay, real_type *az)
+{
+  const real_type rc2 = rc * rc;
+
+#pragma omp parallel for schedule(dynamic,64)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type xi = x[i];
+    const real_type yi = y[i];
+    const real_type zi = z[i];
+    real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+    #pragma omp simd reduction(+:ax_i,ay_i,az_i)
+    for (int k = offset[i]; k < offset[i + 1]; ++k)
+    {
+      const int j = neigh[k];
+      real_type dx = x[j] - xi;						//1flop
+      real_type dy = y[j] - yi;						//1flop
+      real_type dz = z[j] - zi;						//1flop
+
+      real_type r2 = dx*dx + dy*dy + dz*dz;				//5flops
+      real_type distanceInv = 1.0f / sqrtf(r2 + softeningSquared);	//1flop+1div+1sqrt
+
+      real_type f = (r2 < rc2) ? G * m[j] * distanceInv * distanceInv * distanceInv : 0.0f; //4flops
+      ax_i += dx * f;							//2flops
+      ay_i += dy * f;							//2flops
+      az_i += dz * f;							//2flops
+    }
+    ax[i] = ax_i;
+    ay[i] = ay_i;
+    az[i] = az_i;
+  }
+  return (double) offset[n];
+}
+
+// Real space Ewald sum: the direct sum with the minimum image, minus the
+// correction h(r^2) from the table, interpolated between the two entries
+// around r^2 scale. The gathers of the table replace the erfc and the
+// exponential of the split. The pair of i with itself has dx = 0.
+static double ewald_real(ParticleSoA *particles, int n, int nj, real_type G,
+                         real_type softeningSquared, const real_type *table, real_type scale)
+{
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+  const real_type *pm = particles->mass;
+  real_type *ax = particles->acc_x;
+  real_type *ay = particles->acc_y;
+  real_type *az = particles->acc_z;
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type xi = px[i];
+    const real_type yi = py[i];
+    const real_type zi = pz[i];
+    real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+    #pragma omp simd reduction(+:ax_i,ay_i,az_i)
+    for (int j = 0; j < nj; ++j)
+    {
+      real_type dx = px[j] - xi;					//1flop
+      real_type dy = py[j] - yi;					//1flop
+      real_type dz = pz[j] - zi;					//1flop
+      dx -= rintf(dx);							//1flop
+      dy -= rintf(dy);							//1flop
+      dz -= rintf(dz);							//1flop
+
+      real_type r2 = dx*dx + dy*dy + dz*dz;				//5flops
+      real_type distanceInv = 1.0f / sqrtf(r2 + softeningSquared);	//1flop+1div+1sqrt
+
+      real_type u = r2 * scale;						//1flop
+      int k = (int) u;
+      real_type t = u - (real_type) k;					//1flop
+      real_type h = table[k] + t * (table[k + 1] - table[k]);		//3flops
+      real_type f = G * pm[j] * (distanceInv * distanceInv * distanceInv - h); //5flops
+      ax_i += dx * f;							//2flops
+      ay_i += dy * f;							//2flops
+      az_i += dz * f;							//2flops
+    }
+    ax[i] = ax_i;
+    ay[i] = ay_i;
+    az[i] = az_i;
+  }
+  return double(n) * double(nj);
+}
+
+// Fourier part of the Ewald sum, added to the real space one:
+//   a_i = sum_k G coef_k k [sin(k.x_i) C_k - cos(k.x_i) S_k]
+// over half of the k-space, with the structure factor C_k + i S_k of the
+// masses, sum_j m_j exp(i k.x_j). The phases are products of the table
+// entries of the three dimensions; negative m are their conjugates.
+static double ewald_fourier(const real_type *ec, const real_type *es, int np, int nm,
+                            const real_type *m, int n, int nj, const int *mx, const int *my,
+                            const int *mz, const real_type *coef, int nk, real_type G,
+                            real_type *ck, real_type *sk,
+                            real_type *ax, real_type *ay, real_type *az)
+{
+  const int iblock = 256;	//i particles of a block, with their tables in cache
+
+  // structure factors, one k-vector per iteration
+#pragma omp parallel for schedule(static)
+  for (int k = 0; k < nk; ++k)
+  {
+    const real_type sy = (my[k] < 0) ? -1.0f : 1.0f;
+    const real_type sz = (mz[k] < 0) ? -1.0f : 1.0f;
+    const real_type *cx = ec + mx[k] * (size_t) np;
+    const real_type *sx = es + mx[k] * (size_t) np;
+    const real_type *cy = ec + (nm + (my[k] < 0 ? -my[k] : my[k])) * (size_t) np;
+    const real_type *sn = es + (nm + (my[k] < 0 ? -my[k] : my[k])) * (size_t) np;
+    const real_type *cz = ec + (2 * nm + (mz[k] < 0 ? -mz[k] : mz[k])) * (size_t) np;
+    const real_type *sm = es + (2 * nm + (mz[k] < 0 ? -mz[k] : mz[k])) * (size_t) np;
+    real_type C = 0.0f, S = 0.0f;
+    #pragma omp simd reduction(+:C,S)
+    for (int j = 0; j < nj; ++j)
+    {
+      const real_type a = cx[j] * cy[j] - sx[j] * sy * sn[j];		//4flops
+      const real_type b = sx[j] * cy[j] + cx[j] * sy * sn[j];		//4flops
+      const real_type c = a * cz[j] - b * sz * sm[j];			//4flops
+      const real_type s = b * cz[j] + a * sz * sm[j];			//4flops
+      C += m[j] * c;							//2flops
+      S += m[j] * s;							//2flops
+    }
+    ck[k] = G * coef[k] * C;
+    sk[k] = G * coef[k] * S;
+  }
+
+  // forces, blocks of i particles against all the k-vectors
+  const int nblocks = (n + iblock - 1) / iblock;
+#pragma omp parallel for schedule(static)
+  for (int b = 0; b < nblocks; ++b)
+  {
+    const int i0 = b * iblock;
+    const int i1 = (i0 + iblock < n) ? i0 + iblock : n;
+    for (int k = 0; k < nk; ++k)
+    {
+      const real_type sy = (my[k] < 0) ? -1.0f : 1.0f;
+      const real_type sz = (mz[k] < 0) ? -1.0f : 1.0f;
+      const real_type *cx = ec + mx[k] * (size_t) np;
+      const real_type *sx = es + mx[k] * (size_t) np;
+      const real_type *cy = ec + (nm + (my[k] < 0 ? -my[k] : my[k])) * (size_t) np;
+      const real_type *sn = es + (nm + (my[k] < 0 ? -my[k] : my[k])) * (size_t) np;
+      const real_type *cz = ec + (2 * nm + (mz[k] < 0 ? -mz[k] : mz[k])) * (size_t) np;
+      const real_type *sm = es + (2 * nm + (mz[k] < 0 ? -mz[k] : mz[k])) * (size_t) np;
+      const real_type C = ck[k], S = sk[k];
+      const real_type kx = (real_type) mx[k], ky = (real_type) my[k], kz = (real_type) mz[k];
+      #pragma omp simd
+      for (int i = i0; i < i1; ++i)
+      {
+        const real_type a = cx[i] * cy[i] - sx[i] * sy * sn[i];	//4flops
+        const real_type b = sx[i] * cy[i] + cx[i] * sy * sn[i];	//4flops
+        const real_type c = a * cz[i] - b * sz * sm[i];		//4flops
+        const real_type s = b * cz[i] + a * sz * sm[i];		//4flops
+        const real_type f = s * C - c * S;				//3flops
+        ax[i] += kx * f;						//2flops
+        ay[i] += ky * f;						//2flops
+        az[i] += kz * f;						//2flops
+      }
+    }
+  }
+  return double(n + nj) * double(nk);
+}
+
+// Direct sum on the three layouts with the same loop body: i in parallel,
+// j in a SIMD loop. The AoS loads of j are strided, the SoA ones come from
+// four streams and the AoSoA ones from one, a block at a time.
+static double direct_aos(Particle *particles, int n, real_type G, real_type softeningSquared)
+{
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type xi = particles[i].pos[0];
+    const real_type yi = particles[i].pos[1];
+    const real_type zi = particles[i].pos[2];
+    real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+    #pragma omp simd reduction(+:ax_i,ay_i,az_i)
+    for (int j = 0; j < n; ++j)
+    {
+      real_type dx = particles[j].pos[0] - xi;				//1flop
+      real_type dy = particles[j].pos[1] - yi;				//1flop
+      real_type dz = particles[j].pos[2] - zi;				//1flop
+
+      real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
+      real_type distanceInv = 1.0f / sqrtf(distanceSqr);		//1div+1sqrt
+
+      real_type f = G * particles[j].mass * distanceInv * distanceInv * distanceInv; //4flops
+      ax_i += dx * f;							//2flops
+      ay_i += dy * f;							//2flops
+      az_i += dz * f;							//2flops
+    }
+    particles[i].acc[0] = ax_i;
+    particles[i].acc[1] = ay_i;
+    particles[i].acc[2] = az_i;
+  }
+  return double(n) * double(n);
+}
+
+static double direct_soa(ParticleSoA *particles, int n, real_type G, real_type softeningSquared)
+{
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+  const real_type *pm = particles->mass;
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type xi = px[i];
+    const real_type yi = py[i];
+    const real_type zi = pz[i];
+    real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+    #pragma omp simd reduction(+:ax_i,ay_i,az_i)
+    for (int j = 0; j < n; ++j)
+    {
+      real_type dx = px[j] - xi;					//1flop
+      real_type dy = py[j] - yi;					//1flop
+      real_type dz = pz[j] - zi;					//1flop
+
+      real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
+      real_type distanceInv = 1.0f / sqrtf(distanceSqr);		//1div+1sqrt
+
+      real_type f = G * pm[j] * distanceInv * distanceInv * distanceInv; //4flops
+      ax_i += dx * f;							//2flops
+      ay_i += dy * f;							//2flops
+      az_i += dz * f;							//2flops
+    }
+    particles->acc_x[i] = ax_i;
+    particles->acc_y[i] = ay_i;
+    particles->acc_z[i] = az_i;
+  }
+  return double(n) * double(n);
+}
+
+static double direct_aosoa(ParticleBlock<block_width> *blocks, int n, real_type G,
+                           real_type softeningSquared)
+{
+  const int W = block_width;
+  const int nblocks = n / W;
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+  {
+    ParticleBlock<W> &bi = blocks[i / W];
+    const real_type xi = bi.x[i % W];
+    const real_type yi = bi.y[i % W];
+    const real_type zi = bi.z[i % W];
+    // one partial sum per lane, reduced after the last block
+    real_type ax_s[W], ay_s[W], az_s[W];
+    for (int s = 0; s < W; ++s)
+      ax_s[s] = ay_s[s] = az_s[s] = 0.0f;
+    for (int b = 0; b < nblocks; ++b)
+    {
+      const ParticleBlock<W> &bj = blocks[b];
+      #pragma omp simd
+      for (int s = 0; s < W; ++s)
+      {
+        real_type dx = bj.x[s] - xi;					//1flop
+        real_type dy = bj.y[s] - yi;					//1flop
+        real_type dz = bj.z[s] - zi;					//1flop
+
+        real_type distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared; //6flops
+        real_type distanceInv = 1.0f / sqrtf(distanceSqr);		//1div+1sqrt
+
+        real_type f = G * bj.m[s] * distanceInv * distanceInv * distanceInv; //4flops
+        ax_s[s] += dx * f;						//2flops
+        ay_s[s] += dy * f;						//2flops
+        az_s[s] += dz * f;						//2flops
+      }
+    }
+    real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+    for (int s = 0; s < W; ++s)
+    {
+      ax_i += ax_s[s];
+      ay_i += ay_s[s];
+      az_i += az_s[s];
+    }
+    bi.ax[i % W] = ax_i;
+    bi.ay[i % W] = ay_i;
+    bi.az[i % W] = az_i;
+  }
+  return double(n) * double(n);
+}
+
+// Direct sum and Euler step in one pass: the acceleration of an i tile is
+// applied from the registers to its velocity, and the new position goes to
+// the second buffer x_new, y_new, z_new, since the other threads still read
+// the old one. The acceleration arrays are written only if store_acc is set.
+// The np i particles feel the first nj ones, the only ones with mass.
+// With kinetic the sum of m v^2 is returned.
+template<int T>
+static real_type fused_tiles(ParticleSoA *particles, int n, int np, int nj, real_type G,
+                             real_type softeningSquared, real_type dt,
+                             real_type *x_new, real_type *y_new, real_type *z_new, bool store_acc,
+                             bool kinetic, real_type &amax2)
+{
+  const int ntiles = np / T;
+  real_type energy = 0;
+  real_type a2max = 0;
+
+  __assume_aligned(particles->pos_x, alignment);
+  __assume_aligned(particles->pos_y, alignment);
+  __assume_aligned(particles->pos_z, alignment);
+  __assume_aligned(particles->mass, alignment);
+
+#pragma omp parallel for schedule(static) reduction(+:energy) reduction(max:a2max)
+  for (int t = 0; t < ntiles; ++t)
+  {
+    const int ii = t * T;
+    real_type xi[T], yi[T], zi[T];
+    real_type acc_xtile[T], acc_ytile[T], acc_ztile[T];
+    for (int s = 0; s < T; s++)
+    {
+      xi[s] = particles->pos_x[ii + s];
+      yi[s] = particles->pos_y[ii + s];
+      zi[s] = particles->pos_z[ii + s];
+      acc_xtile[s] = 0.0f;
+      acc_ytile[s] = 0.0f;
+      acc_ztile[s] = 0.0f;
+    }
+
+    #pragma omp simd
+    for (int j = 0; j < nj; j++)
+    {
+      for (int s = 0; s < T; s++)
+      {
+        real_type dx, dy, dz;
+        real_type distanceSqr = 0.0f;
+        real_type distanceInv = 0.0f;
+
+        dx = particles->pos_x[j] - xi[s];				//1flop
+        dy = particles->pos_y[j] - yi[s];				//1flop
+        dz = particles->pos_z[j] - zi[s];				//1flop
+
+        distanceSqr = dx*dx + dy*dy + dz*dz + softeningSquared;	//6flops
+        distanceInv = 1.0f / sqrtf(distanceSqr);			//1div+1sqrt
+
+        acc_xtile[s] += dx * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
+        acc_ytile[s] += dy * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
+        acc_ztile[s] += dz * G * particles->mass[j] * distanceInv * distanceInv * distanceInv; //6flops
+      }
+    }
+
+    for (int s = 0; s < T; s++)
+    {
+      const int i = ii + s;
+      if(store_acc)
+      {
+        particles->acc_x[i] = acc_xtile[s];
+        particles->acc_y[i] = acc_ytile[s];
+        particles->acc_z[i] = acc_ztile[s];
+      }
+      // the ghosts stay where they are
+      if(i >= n)
+      {
+        x_new[i] = xi[s];
+        y_new[i] = yi[s];
+        z_new[i] = zi[s];
+        continue;
+      }
+      const real_type a2 = acc_xtile[s]*acc_xtile[s] + acc_ytile[s]*acc_ytile[s] +
+                           acc_ztile[s]*acc_ztile[s];
+      a2max = (a2 > a2max) ? a2 : a2max;
+
+      particles->vel_x[i] += acc_xtile[s] * dt;			//2flops
+      particles->vel_y[i] += acc_ytile[s] * dt;			//2flops
+      particles->vel_z[i] += acc_ztile[s] * dt;			//2flops
+
+      x_new[i] = xi[s] + particles->vel_x[i] * dt;			//2flops
+      y_new[i] = yi[s] + particles->vel_y[i] * dt;			//2flops
+      z_new[i] = zi[s] + particles->vel_z[i] * dt;			//2flops
+
+      if(kinetic)
+        energy += particles->mass[i] * (
+                  particles->vel_x[i]*particles->vel_x[i] +
+                  particles->vel_y[i]*particles->vel_y[i] +
+                  particles->vel_z[i]*particles->vel_z[i]);		//7flops
+    }
+  }
+  amax2 = a2max;
+  return energy;
+}
+
+static real_type fused(ParticleSoA *particles, int n, int np, int nj, real_type G,
+                       real_type softeningSquared, real_type dt, int itile,
+                       real_type *x_new, real_type *y_new, real_type *z_new, bool store_acc,
+                       bool kinetic, real_type &amax2)
+{
+  switch(itile)
+  {
+    case 2:  return fused_tiles<2>(particles, n, np, nj, G, softeningSquared, dt, x_new, y_new, z_new, store_acc, kinetic, amax2);
+    case 4:  return fused_tiles<4>(particles, n, np, nj, G, softeningSquared, dt, x_new, y_new, z_new, store_acc, kinetic, amax2);
+    case 16: return fused_tiles<16>(particles, n, np, nj, G, softeningSquared, dt, x_new, y_new, z_new, store_acc, kinetic, amax2);
+    case 8:
+    default: return fused_tiles<8>(particles, n, np, nj, G, softeningSquared, dt, x_new, y_new, z_new, store_acc, kinetic, amax2);
+  }
+}
+
+extern const KernelTable KERNEL_NAME(kernels) =
+{
+  KERNEL_STR(KERNEL_ISA),
+  direct_pragma,
+  KERNEL_NAME(direct_forces_intrin),
+  symmetric,
+  update,
+  fused,
+  kick_drift,
+  kick,
+  predict,
+  hermite,
+  predict_block,
+  hermite_active,
+  potential,
+  respa_far,
+  neighbours,
+  ewald_real,
+  ewald_fourier,
+  direct_aos,
+  direct_soa,
+  direct_aosoa,
+  direct_kick,
+  drift
+};
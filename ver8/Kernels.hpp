@@ -0,0 +1,158 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _KERNELS_HPP
+#define _KERNELS_HPP
+
+#include "Particle.hpp"
+
+// The force and integration kernels of the simulation are compiled once for
+// every instruction set, SSE4.2, AVX2 and AVX-512 (the OBJSK objects of the
+// Makefile), and the best one supported by the CPU is chosen at startup. Each build of Kernels.cpp and
+// IntrinKernel.cpp exports its functions with the ISA as a suffix, e.g.
+// kernels_avx2, so that the builds can be linked in one executable.
+// The direct sum kernels take the particle count padded to a multiple of 16
+// with zero mass ghosts (see GSimulation::init_ghosts). The j range of
+// direct_pragma and fused can be any count: with tracers it stops at the
+// massive particles, stored first.
+struct KernelTable
+{
+  const char *isa;		//name of the instruction set
+
+  // direct sum vectorized by the compiler, on the first ni particles (a
+  // multiple of 16) from the first n, blocked in tiles of itile (2, 4, 8 or
+  // 16) i and jtile j particles; the potential energy of the ni particles
+  // is accumulated in the same pass if epot is not NULL. If jbuf is not
+  // NULL, the j particles are first packed there as 4n floats {x, y, z, G m}
+  // and streamed from it
+  double (*direct_pragma)(ParticleSoA *particles, int n, real_type G, real_type softeningSquared,
+                          int ni, int itile, int jtile, double *epot, real_type *jbuf);
+
+  // direct sum written with intrinsics, from the first nj particles
+  double (*direct_intrin)(ParticleSoA *particles, int n, int nj, real_type G,
+                          real_type softeningSquared);
+
+  // direct sum evaluating each pair once, with 3 per-thread buffers of
+  // stride floats each in tbuf; the pairs of two particles after the first
+  // nj, which have no mass, are skipped
+  double (*symmetric)(ParticleSoA *particles, int n, int nj, real_type G,
+                      real_type softeningSquared, real_type *tbuf, int stride);
+
+  // The integration kernels below return the sum of m v^2, only if kinetic
+  // (0 otherwise), and in amax2 the largest squared acceleration for the
+  // adaptive time step
+
+  // Euler step of all particles, clear the accelerations
+  real_type (*update)(ParticleSoA *particles, int n, real_type dt, bool kinetic,
+                      real_type &amax2);
+
+  // direct sum from the first nj particles fused with the Euler step of the
+  // n real particles, blocked in tiles of itile i particles: the new
+  // positions are written to x_new, y_new, z_new and the accelerations only
+  // if store_acc; the sum of m v^2 is returned if kinetic
+  real_type (*fused)(ParticleSoA *particles, int n, int np, int nj, real_type G,
+                     real_type softeningSquared, real_type dt, int itile,
+                     real_type *x_new, real_type *y_new, real_type *z_new, bool store_acc,
+                     bool kinetic, real_type &amax2);
+
+  // leapfrog: half kick and drift, then half kick
+  void (*kick_drift)(ParticleSoA *particles, int n, real_type dt);
+  real_type (*kick)(ParticleSoA *particles, int n, real_type dt, bool kinetic,
+                    real_type &amax2);
+
+  // Hermite: prediction of all np particles, then acceleration and jerk at
+  // the predicted state and, if correct, the corrector
+  void (*predict)(ParticleSoA *particles, int np, real_type dt);
+  real_type (*hermite)(ParticleSoA *particles, int n, int np, real_type G,
+                       real_type softeningSquared, real_type dt, bool correct,
+                       bool kinetic, real_type &amax2);
+
+  // Hermite with block time steps: prediction of all np particles to the
+  // time t from their last time tlast, then the step of the nact particles
+  // in the list active, each over its own step dt, giving the new step
+  // from the Aarseth criterion with accuracy eta in dtcrit
+  void (*predict_block)(ParticleSoA *particles, int np, double t, const double *tlast);
+  void (*hermite_active)(ParticleSoA *particles, int np, real_type G, real_type softeningSquared,
+                         const int *active, int nact, const double *dt, real_type eta,
+                         real_type *dtcrit);
+
+  // potential energy of the n particles
+  double (*potential)(ParticleSoA *particles, int n, real_type G, real_type softeningSquared);
+  
+  // RESPA far field of the n particles from all the np, with the switch
+  // going from 1 at rin to 0 at rc, written to ax, ay, az
+  double (*respa_far)(ParticleSoA *particles, int n, int np, real_type G,
+                      real_type softeningSquared, real_type rin, real_type rc,
+                      real_type *ax, real_type *ay, real_type *az);
+  
+  // cutoff force on the n particles x, y, z, m from their neighbours in
+  // the CSR lists offset, neigh, written to ax, ay, az
+  double (*neighbours)(const real_type *x, const real_type *y, const real_type *z,
+                       const real_type *m, int n, const int *offset, const int *neigh,
+                       real_type G, real_type softeningSquared, real_type rc,
+                       real_type *ax, real_type *ay, real_type *az);
+  
+  // real space part of the Ewald sum on the n particles from the first nj,
+  // with the minimum image: the softened pair force minus the correction
+  // h(r^2), linearly interpolated in table, which has scale entries per
+  // unit r^2
+  double (*ewald_real)(ParticleSoA *particles, int n, int nj, real_type G,
+                       real_type softeningSquared, const real_type *table, real_type scale);
+  
+  // Fourier part of the Ewald sum over the nk k-vectors 2 pi (mx,my,mz) of
+  // half the k-space, from the tables ec, es of cos and sin of 2 pi m x, for
+  // m from 0 to nm-1, per dimension and for np particles: the structure
+  // factors of the first nj, times G coef, go to ck, sk and the
+  // accelerations of the first n are added to ax, ay, az
+  double (*ewald_fourier)(const real_type *ec, const real_type *es, int np, int nm,
+                          const real_type *m, int n, int nj, const int *mx, const int *my,
+                          const int *mz, const real_type *coef, int nk, real_type G,
+                          real_type *ck, real_type *sk,
+                          real_type *ax, real_type *ay, real_type *az);
+  
+  // the same direct sum, without tiles, on the three particle layouts of
+  // the -layout benchmark: AoS, SoA and AoSoA blocks; n is a multiple of
+  // block_width
+  double (*direct_aos)(Particle *particles, int n, real_type G, real_type softeningSquared);
+  double (*direct_soa)(ParticleSoA *particles, int n, real_type G, real_type softeningSquared);
+  double (*direct_aosoa)(ParticleBlock<block_width> *blocks, int n, real_type G,
+                         real_type softeningSquared);
+  
+  // low memory Euler step, without acceleration arrays: the direct sum of
+  // direct_pragma kicks the velocities of the ni particles by dt right
+  // away; then the drift of the n particles returns the sum of m v^2 if
+  // kinetic
+  double (*direct_kick)(ParticleSoA *particles, int n, real_type G, real_type softeningSquared,
+                        int ni, int itile, int jtile, real_type dt, real_type &amax2);
+  real_type (*drift)(ParticleSoA *particles, int n, real_type dt, bool kinetic);
+};
+
+#define KERNEL_CAT2(a,b) a ## _ ## b
+#define KERNEL_CAT(a,b) KERNEL_CAT2(a,b)
+#define KERNEL_NAME(f) KERNEL_CAT(f,KERNEL_ISA)
+#define KERNEL_STR2(a) #a
+#define KERNEL_STR(a) KERNEL_STR2(a)
+
+extern const KernelTable kernels_sse42;
+extern const KernelTable kernels_avx2;
+extern const KernelTable kernels_avx512;
+
+#endif
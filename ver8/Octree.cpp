@@ -0,0 +1,233 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <utility>
+#include <mm_malloc.h>
+
+#include "Octree.hpp"
+
+static const int alignment = 32;
+static const int max_level = 21;	//bits per dimension in the Morton key
+
+// spread the lower 21 bits of v so that there are two zeros between each bit
+static inline uint64_t split_by_3(uint64_t v)
+{
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+  v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2)  & 0x1249249249249249ULL;
+  return v;
+}
+
+uint64_t morton_key(real_type x, real_type y, real_type z)
+{
+  const real_type scale = (real_type) (1 << max_level);
+  uint64_t ix = (uint64_t) std::min(std::max(x * scale, (real_type) 0), scale - 1);
+  uint64_t iy = (uint64_t) std::min(std::max(y * scale, (real_type) 0), scale - 1);
+  uint64_t iz = (uint64_t) std::min(std::max(z * scale, (real_type) 0), scale - 1);
+  return (split_by_3(ix) << 2) | (split_by_3(iy) << 1) | split_by_3(iz);
+}
+
+Octree :: Octree(int leaf_size) : _n(0), x(NULL), y(NULL), z(NULL), m(NULL), index(NULL),
+                                  _leaf_size(leaf_size), _capacity(0)
+{
+}
+
+Octree :: ~Octree()
+{
+  _mm_free(x);
+  _mm_free(y);
+  _mm_free(z);
+  _mm_free(m);
+  _mm_free(index);
+}
+
+void Octree :: reserve(int n)
+{
+  if(n <= _capacity) return;
+  _mm_free(x);
+  _mm_free(y);
+  _mm_free(z);
+  _mm_free(m);
+  _mm_free(index);
+  x = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  y = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  z = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  m = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  index = (int*) _mm_malloc(n*sizeof(int),alignment);
+  _capacity = n;
+}
+
+void Octree :: build(const ParticleSoA *particles, int n)
+{
+  _n = n;
+  reserve(n);
+
+  real_type xmin = particles->pos_x[0], xmax = xmin;
+  real_type ymin = particles->pos_y[0], ymax = ymin;
+  real_type zmin = particles->pos_z[0], zmax = zmin;
+#pragma omp parallel for reduction(min:xmin,ymin,zmin) reduction(max:xmax,ymax,zmax)
+  for (int i = 0; i < n; ++i)
+  {
+    xmin = std::min(xmin, particles->pos_x[i]); xmax = std::max(xmax, particles->pos_x[i]);
+    ymin = std::min(ymin, particles->pos_y[i]); ymax = std::max(ymax, particles->pos_y[i]);
+    zmin = std::min(zmin, particles->pos_z[i]); zmax = std::max(zmax, particles->pos_z[i]);
+  }
+  // slightly enlarged cube, so that no particle sits on the upper face
+  _size = std::max(xmax - xmin, std::max(ymax - ymin, zmax - zmin)) * 1.0001f + 1.e-6f;
+  _xmin = xmin; _ymin = ymin; _zmin = zmin;
+
+  std::vector< std::pair<uint64_t,int> > keyed(n);
+  const real_type inv_size = 1.0f / _size;
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    keyed[i].first  = morton_key((particles->pos_x[i] - _xmin) * inv_size,
+                                 (particles->pos_y[i] - _ymin) * inv_size,
+                                 (particles->pos_z[i] - _zmin) * inv_size);
+    keyed[i].second = i;
+  }
+  std::sort(keyed.begin(), keyed.end());
+
+  _keys.resize(n);
+#pragma omp parallel for
+  for (int k = 0; k < n; ++k)
+  {
+    const int i = keyed[k].second;
+    _keys[k] = keyed[k].first;
+    index[k] = i;
+    x[k] = particles->pos_x[i];
+    y[k] = particles->pos_y[i];
+    z[k] = particles->pos_z[i];
+    m[k] = particles->mass[i];
+  }
+
+  _nodes.clear();
+  _leaves.clear();
+  OctreeNode root;
+  root.half = 0.5f * _size;
+  root.cx = _xmin + root.half;
+  root.cy = _ymin + root.half;
+  root.cz = _zmin + root.half;
+  root.begin = 0;
+  root.end = n;
+  root.level = 0;
+  _nodes.push_back(root);
+  build_node(0, 0);
+}
+
+void Octree :: build_node(int node, int level)
+{
+  const int begin = _nodes[node].begin;
+  const int end   = _nodes[node].end;
+
+  double mass = 0., mx = 0., my = 0., mz = 0.;
+  for (int k = begin; k < end; ++k)
+  {
+    mass += m[k];
+    mx += m[k] * x[k];
+    my += m[k] * y[k];
+    mz += m[k] * z[k];
+  }
+  OctreeNode &cell = _nodes[node];
+  cell.mass = mass;
+  if(mass > 0.)
+  {
+    cell.mx = mx / mass; cell.my = my / mass; cell.mz = mz / mass;
+  }
+  else
+  {
+    cell.mx = cell.cx; cell.my = cell.cy; cell.mz = cell.cz;
+  }
+
+  if(end - begin <= _leaf_size || level == max_level)
+  {
+    cell.child = -1;
+    cell.nchild = 0;
+    _leaves.push_back(node);
+    return;
+  }
+
+  // the octant at this level is given by three bits of the sorted keys,
+  // so every child is a contiguous sub-range of the parent
+  const int shift = 3 * (max_level - 1 - level);
+  int first[9];
+  int k = begin;
+  for (int o = 0; o < 8; ++o)
+  {
+    first[o] = k;
+    while(k < end && (int) ((_keys[k] >> shift) & 7) == o) ++k;
+  }
+  first[8] = end;
+
+  const real_type half = 0.5f * cell.half;
+  const real_type cx = cell.cx, cy = cell.cy, cz = cell.cz;
+  const int child = (int) _nodes.size();
+  int nchild = 0;
+  for (int o = 0; o < 8; ++o)
+  {
+    if(first[o+1] == first[o]) continue;
+    OctreeNode c;
+    c.half = half;
+    c.cx = cx + ((o & 4) ? half : -half);
+    c.cy = cy + ((o & 2) ? half : -half);
+    c.cz = cz + ((o & 1) ? half : -half);
+    c.begin = first[o];
+    c.end = first[o+1];
+    c.level = level + 1;
+    _nodes.push_back(c);
+    ++nchild;
+  }
+  // the vector may have been reallocated: do not use the reference anymore
+  _nodes[node].child = child;
+  _nodes[node].nchild = nchild;
+
+  for (int c = child; c < child + nchild; ++c)
+    build_node(c, level + 1);
+}
+
+void Octree :: scatter_acc(ParticleSoA *particles,
+                           const real_type *ax, const real_type *ay, const real_type *az,
+                           bool accumulate) const
+{
+  if(accumulate)
+  {
+#pragma omp parallel for
+    for (int k = 0; k < _n; ++k)
+    {
+      const int i = index[k];
+      particles->acc_x[i] += ax[k];
+      particles->acc_y[i] += ay[k];
+      particles->acc_z[i] += az[k];
+    }
+    return;
+  }
+#pragma omp parallel for
+  for (int k = 0; k < _n; ++k)
+  {
+    const int i = index[k];
+    particles->acc_x[i] = ax[k];
+    particles->acc_y[i] = ay[k];
+    particles->acc_z[i] = az[k];
+  }
+}
@@ -0,0 +1,87 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OCTREE_HPP
+#define _OCTREE_HPP
+
+#include <vector>
+#include <stdint.h>
+
+#include "Particle.hpp"
+
+// One cell of the octree. The children of a cell are stored contiguously
+// in the node array, and the particles of a cell are the contiguous range
+// [begin,end) of the Morton-sorted particle copies held by the tree.
+struct OctreeNode
+{
+  real_type cx, cy, cz;		//geometric centre of the cell
+  real_type half;		//half of the cell side
+  real_type mx, my, mz;		//centre of mass
+  real_type mass;		//total mass
+  int begin, end;		//range of sorted particles
+  int child;			//index of the first child, -1 for a leaf
+  int nchild;			//number of (non empty) children
+  int level;			//depth in the tree, 0 for the root
+};
+
+class Octree
+{
+public:
+  Octree(int leaf_size = 16);
+  ~Octree();
+
+  // Sort the particles along the Morton curve and build the cells
+  void build(const ParticleSoA *particles, int n);
+
+  // Scatter accelerations given in tree order back to the particle arrays,
+  // overwriting or adding to the values already there
+  void scatter_acc(ParticleSoA *particles,
+                   const real_type *ax, const real_type *ay, const real_type *az,
+                   bool accumulate = false) const;
+
+  inline int get_nleaves() const {return (int) _leaves.size(); }
+  inline int get_nnodes() const {return (int) _nodes.size(); }
+  inline int get_leaf_size() const {return _leaf_size; }
+
+  std::vector<OctreeNode> _nodes;	//nodes[0] is the root
+  std::vector<int> _leaves;		//indices of the leaf cells
+
+  // particle copies in Morton order
+  int _n;
+  real_type *x, *y, *z, *m;
+  int *index;				//original index of each sorted particle
+
+  // bounding cube of the particles
+  real_type _xmin, _ymin, _zmin;
+  real_type _size;
+
+private:
+  int _leaf_size;
+  int _capacity;
+  std::vector<uint64_t> _keys;
+
+  void reserve(int n);
+  void build_node(int node, int level);
+};
+
+// 63 bit Morton key of a position given in units of the bounding cube
+uint64_t morton_key(real_type x, real_type y, real_type z);
+
+#endif
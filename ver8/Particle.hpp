@@ -21,6 +21,8 @@
 #ifndef _PARTICLE_HPP
 #define _PARTICLE_HPP
 #include <cmath>
+#include <cstring>
+#include <mm_malloc.h>
 #include "types.hpp"
 
 struct Particle
@@ -50,11 +52,78 @@ struct ParticleSoA
       vel_x = NULL; vel_y = NULL; vel_z = NULL;
       acc_x = NULL; acc_y = NULL; acc_z = NULL;
       mass  = NULL;
+      jrk_x = NULL; jrk_y = NULL; jrk_z = NULL;
+      ppos_x = NULL; ppos_y = NULL; ppos_z = NULL;
+      pvel_x = NULL; pvel_y = NULL; pvel_z = NULL;
     }
     real_type *pos_x, *pos_y, *pos_z;
     real_type *vel_x, *vel_y, *vel_z;
     real_type *acc_x, *acc_y, *acc_z;  
     real_type *mass;
+    // Hermite integrator only
+    real_type *jrk_x, *jrk_y, *jrk_z;		//jerk, da/dt
+    real_type *ppos_x, *ppos_y, *ppos_z;	//predicted positions
+    real_type *pvel_x, *pvel_y, *pvel_z;	//predicted velocities
+};
+
+// Array of structures of arrays: the particles in blocks of W, W the SIMD
+// width, each block holding W values of every field. A vector load of a
+// field is contiguous, as in ParticleSoA, but the fields of a particle are
+// a few cache lines apart instead of ten streams apart.
+template<int W>
+struct ParticleBlock
+{
+  real_type x[W], y[W], z[W];
+  real_type vx[W], vy[W], vz[W];
+  real_type ax[W], ay[W], az[W];
+  real_type m[W];
+};
+
+// particles of a block: one AVX-512 vector of floats, and the padding of
+// the simulation
+static const int block_width = 16;
+
+// Container of ParticleBlock: particle i is element i % W of block i / W,
+// the last block is filled with zero mass particles. The accessors are for
+// the setup code; the kernels loop over the blocks and their elements.
+template<int W>
+class ParticleAoSoA
+{
+public:
+  ParticleAoSoA() : _n(0), _nblocks(0), _blocks(NULL) {}
+  ~ParticleAoSoA() { _mm_free(_blocks); }
+
+  void resize(int n)
+  {
+    _mm_free(_blocks);
+    _n = n;
+    _nblocks = (n + W - 1) / W;
+    _blocks = (ParticleBlock<W>*) _mm_malloc(_nblocks * sizeof(ParticleBlock<W>), 64);
+    memset(_blocks, 0, _nblocks * sizeof(ParticleBlock<W>));
+  }
+
+  inline int size() const {return _n; }
+  inline int get_nblocks() const {return _nblocks; }
+  inline ParticleBlock<W> *blocks() {return _blocks; }
+
+  inline real_type &pos_x(int i) {return _blocks[i / W].x[i % W]; }
+  inline real_type &pos_y(int i) {return _blocks[i / W].y[i % W]; }
+  inline real_type &pos_z(int i) {return _blocks[i / W].z[i % W]; }
+  inline real_type &vel_x(int i) {return _blocks[i / W].vx[i % W]; }
+  inline real_type &vel_y(int i) {return _blocks[i / W].vy[i % W]; }
+  inline real_type &vel_z(int i) {return _blocks[i / W].vz[i % W]; }
+  inline real_type &acc_x(int i) {return _blocks[i / W].ax[i % W]; }
+  inline real_type &acc_y(int i) {return _blocks[i / W].ay[i % W]; }
+  inline real_type &acc_z(int i) {return _blocks[i / W].az[i % W]; }
+  inline real_type &mass(int i)  {return _blocks[i / W].m[i % W]; }
+
+private:
+  int _n;			//number of particles
+  int _nblocks;			//number of blocks
+  ParticleBlock<W> *_blocks;
+
+  ParticleAoSoA(const ParticleAoSoA &);
+  ParticleAoSoA &operator=(const ParticleAoSoA &);
 };
 
 #endif
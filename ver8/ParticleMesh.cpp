@@ -0,0 +1,257 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <omp.h>
+
+#include "ParticleMesh.hpp"
+
+// cloud-in-cell: lower grid point and weight of the upper one, for a
+// periodic coordinate and cell centred grid points
+static inline void cic(real_type x, int ng, int &i0, real_type &d)
+{
+  real_type u = (x - floorf(x)) * ng - 0.5f;
+  real_type f = floorf(u);
+  d  = u - f;
+  i0 = ((int) f + ng) % ng;
+}
+
+// a power of two, at least 4 so that even and odd slabs never overlap
+static int grid_size(int ngrid)
+{
+  int ng = 4;
+  while(ng < ngrid) ng *= 2;
+  return ng;
+}
+
+ParticleMesh :: ParticleMesh(int ngrid) : _ngrid(grid_size(ngrid)), _rs(0.0f), _fft(_ngrid)
+{
+  const size_t ng3 = (size_t) _ngrid * _ngrid * _ngrid;
+  _rho.resize(ng3);
+  _gx.resize(ng3);
+  _gy.resize(ng3);
+  _gz.resize(ng3);
+}
+
+double ParticleMesh :: compute_forces(ParticleSoA *particles, int n, real_type G)
+{
+  sort_by_slab(particles, n);
+  deposit(particles);
+  solve(G);
+  gradient();
+  interpolate(particles, n);
+  return double(n);
+}
+
+// counting sort of the particles by x slab, parallel over fixed blocks of
+// particles so that the result does not depend on the number of threads
+void ParticleMesh :: sort_by_slab(const ParticleSoA *particles, int n)
+{
+  const int ng = _ngrid;
+  const int nslab = ng / 2;
+  const int nblock = omp_get_max_threads();
+
+  _slab.resize(n);
+  _order.resize(n);
+  _count.assign(nslab * nblock + 1, 0);
+
+#pragma omp parallel for
+  for (int b = 0; b < nblock; ++b)
+  {
+    const int first = (int) ((long) n * b / nblock);
+    const int last  = (int) ((long) n * (b + 1) / nblock);
+    for (int i = first; i < last; ++i)
+    {
+      int i0;
+      real_type d;
+      cic(particles->pos_x[i], ng, i0, d);
+      _slab[i] = i0 / 2;
+      ++_count[_slab[i] * nblock + b];
+    }
+  }
+
+  int offset = 0;
+  for (int c = 0; c < nslab * nblock; ++c)
+  {
+    const int cnt = _count[c];
+    _count[c] = offset;
+    offset += cnt;
+  }
+  _count[nslab * nblock] = n;
+
+  _slab_start.resize(nslab + 1);
+  for (int s = 0; s <= nslab; ++s)
+    _slab_start[s] = _count[s * nblock];
+
+#pragma omp parallel for
+  for (int b = 0; b < nblock; ++b)
+  {
+    const int first = (int) ((long) n * b / nblock);
+    const int last  = (int) ((long) n * (b + 1) / nblock);
+    for (int i = first; i < last; ++i)
+      _order[_count[_slab[i] * nblock + b]++] = i;
+  }
+}
+
+void ParticleMesh :: deposit(const ParticleSoA *particles)
+{
+  const int ng = _ngrid;
+  const int nslab = ng / 2;
+  const long ng2 = (long) ng * ng;
+  const real_type cellVolumeInv = (real_type) ng * ng * ng;
+
+#pragma omp parallel for
+  for (long c = 0; c < ng2 * ng; ++c)
+    _rho[c] = 0.;
+
+  // a slab touches its own two planes and the first plane of the next slab
+  for (int parity = 0; parity < 2; ++parity)
+  {
+#pragma omp parallel for schedule(dynamic,1)
+    for (int s = parity; s < nslab; s += 2)
+    {
+      for (int k = _slab_start[s]; k < _slab_start[s+1]; ++k)
+      {
+        const int i = _order[k];
+        int ix, iy, iz;
+        real_type dx, dy, dz;
+        cic(particles->pos_x[i], ng, ix, dx);
+        cic(particles->pos_y[i], ng, iy, dy);
+        cic(particles->pos_z[i], ng, iz, dz);
+        const int jx = (ix + 1) % ng, jy = (iy + 1) % ng, jz = (iz + 1) % ng;
+        const real_type m = particles->mass[i] * cellVolumeInv;
+        const real_type tx = 1.0f - dx, ty = 1.0f - dy, tz = 1.0f - dz;
+
+        _rho[ix*ng2 + iy*ng + iz] += m * tx * ty * tz;
+        _rho[ix*ng2 + iy*ng + jz] += m * tx * ty * dz;
+        _rho[ix*ng2 + jy*ng + iz] += m * tx * dy * tz;
+        _rho[ix*ng2 + jy*ng + jz] += m * tx * dy * dz;
+        _rho[jx*ng2 + iy*ng + iz] += m * dx * ty * tz;
+        _rho[jx*ng2 + iy*ng + jz] += m * dx * ty * dz;
+        _rho[jx*ng2 + jy*ng + iz] += m * dx * dy * tz;
+        _rho[jx*ng2 + jy*ng + jz] += m * dx * dy * dz;
+      }
+    }
+  }
+}
+
+// phi_k = -4 pi G rho_k / k^2 exp(-k^2 rs^2), deconvolved once by the
+// cloud-in-cell window: the full correction of both the assignment and the
+// interpolation, sinc^4 per dimension, amplifies the aliasing near Nyquist
+void ParticleMesh :: solve(real_type G)
+{
+  const int ng = _ngrid;
+  const long ng2 = (long) ng * ng;
+
+  std::vector<double> k2(ng), window(ng);
+  for (int i = 0; i < ng; ++i)
+  {
+    const int m = (i <= ng / 2) ? i : i - ng;
+    const double k = 2.0 * M_PI * m;
+    const double arg = M_PI * m / ng;
+    const double sinc = (m == 0) ? 1.0 : sin(arg) / arg;
+    k2[i] = k * k;
+    window[i] = sinc * sinc;
+  }
+
+  _fft.forward(&_rho[0]);
+
+  const double norm = -4.0 * M_PI * G / ((double) ng2 * ng);
+  const double rs2 = (double) _rs * _rs;
+#pragma omp parallel for
+  for (long c = 0; c < ng2 * ng; ++c)
+  {
+    const int ix = c / ng2, iy = (c / ng) % ng, iz = c % ng;
+    const double kk = k2[ix] + k2[iy] + k2[iz];
+    if(kk == 0.)
+    {
+      _rho[c] = 0.;
+      continue;
+    }
+    const double w = window[ix] * window[iy] * window[iz];
+    _rho[c] *= norm * exp(-kk * rs2) / (kk * w);
+  }
+
+  _fft.inverse(&_rho[0]);
+}
+
+// acceleration = -grad(phi) with the four point finite difference
+void ParticleMesh :: gradient()
+{
+  const int ng = _ngrid;
+  const long ng2 = (long) ng * ng;
+  const double c1 = 2.0 / 3.0 * ng;
+  const double c2 = 1.0 / 12.0 * ng;
+
+#pragma omp parallel for
+  for (long c = 0; c < ng2 * ng; ++c)
+  {
+    const int ix = c / ng2, iy = (c / ng) % ng, iz = c % ng;
+    const int xp1 = (ix + 1) % ng, xm1 = (ix + ng - 1) % ng;
+    const int xp2 = (ix + 2) % ng, xm2 = (ix + ng - 2) % ng;
+    const int yp1 = (iy + 1) % ng, ym1 = (iy + ng - 1) % ng;
+    const int yp2 = (iy + 2) % ng, ym2 = (iy + ng - 2) % ng;
+    const int zp1 = (iz + 1) % ng, zm1 = (iz + ng - 1) % ng;
+    const int zp2 = (iz + 2) % ng, zm2 = (iz + ng - 2) % ng;
+    const long yz = iy * ng + iz, xz = ix * ng2 + iz, xy = ix * ng2 + iy * ng;
+
+    _gx[c] = -(c1 * (_rho[xp1*ng2 + yz].real() - _rho[xm1*ng2 + yz].real())
+             - c2 * (_rho[xp2*ng2 + yz].real() - _rho[xm2*ng2 + yz].real()));
+    _gy[c] = -(c1 * (_rho[xz + yp1*ng].real() - _rho[xz + ym1*ng].real())
+             - c2 * (_rho[xz + yp2*ng].real() - _rho[xz + ym2*ng].real()));
+    _gz[c] = -(c1 * (_rho[xy + zp1].real() - _rho[xy + zm1].real())
+             - c2 * (_rho[xy + zp2].real() - _rho[xy + zm2].real()));
+  }
+}
+
+void ParticleMesh :: interpolate(ParticleSoA *particles, int n) const
+{
+  const int ng = _ngrid;
+  const long ng2 = (long) ng * ng;
+
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    int ix, iy, iz;
+    real_type dx, dy, dz;
+    cic(particles->pos_x[i], ng, ix, dx);
+    cic(particles->pos_y[i], ng, iy, dy);
+    cic(particles->pos_z[i], ng, iz, dz);
+    const int jx = (ix + 1) % ng, jy = (iy + 1) % ng, jz = (iz + 1) % ng;
+    const real_type tx = 1.0f - dx, ty = 1.0f - dy, tz = 1.0f - dz;
+
+    const long c[8] = { ix*ng2 + iy*ng + iz, ix*ng2 + iy*ng + jz,
+                        ix*ng2 + jy*ng + iz, ix*ng2 + jy*ng + jz,
+                        jx*ng2 + iy*ng + iz, jx*ng2 + iy*ng + jz,
+                        jx*ng2 + jy*ng + iz, jx*ng2 + jy*ng + jz };
+    const real_type w[8] = { tx*ty*tz, tx*ty*dz, tx*dy*tz, tx*dy*dz,
+                             dx*ty*tz, dx*ty*dz, dx*dy*tz, dx*dy*dz };
+    real_type ax = 0.0f, ay = 0.0f, az = 0.0f;
+    for (int k = 0; k < 8; ++k)
+    {
+      ax += w[k] * _gx[c[k]];
+      ay += w[k] * _gy[c[k]];
+      az += w[k] * _gz[c[k]];
+    }
+    particles->acc_x[i] = ax;
+    particles->acc_y[i] = ay;
+    particles->acc_z[i] = az;
+  }
+}
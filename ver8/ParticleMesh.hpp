@@ -0,0 +1,71 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PARTICLEMESH_HPP
+#define _PARTICLEMESH_HPP
+
+#include <vector>
+
+#include "Particle.hpp"
+#include "FFT.hpp"
+
+// Particle-Mesh solver in the periodic unit box [0,1)^3:
+// cloud-in-cell mass assignment, FFT Poisson solve, four point finite
+// difference gradient and cloud-in-cell interpolation of the accelerations.
+// The deposit is free of atomics: particles are binned in x slabs two
+// cells wide, and even and odd slabs are deposited in two parallel sweeps.
+class ParticleMesh
+{
+public:
+  ParticleMesh(int ngrid = 64);
+
+  // Compute the accelerations of all particles, return the number of
+  // particles assigned to the mesh
+  double compute_forces(ParticleSoA *particles, int n, real_type G);
+
+  inline int get_ngrid() const {return _ngrid; }
+
+  // Keep only the long range part of the force, exp(-k^2 rs^2) in Fourier
+  // space; rs = 0 gives the full force. Alone, the same filter smooths
+  // the mesh force on the scale of the softening
+  inline void set_split(const real_type &rs){ _rs = rs; }
+  inline real_type get_split() const {return _rs; }
+
+private:
+  int _ngrid;			//grid points per dimension (power of two)
+  real_type _rs;		//long/short range split radius
+  FFT3D _fft;
+
+  std::vector<complex_type> _rho;	//density, then potential
+  std::vector<real_type> _gx, _gy, _gz;	//acceleration on the grid
+
+  std::vector<int> _slab;		//slab of each particle
+  std::vector<int> _order;		//particles sorted by slab
+  std::vector<int> _slab_start;		//first sorted particle of each slab
+  std::vector<int> _count;
+
+  void sort_by_slab(const ParticleSoA *particles, int n);
+  void deposit(const ParticleSoA *particles);
+  void solve(real_type G);
+  void gradient();
+  void interpolate(ParticleSoA *particles, int n) const;
+};
+
+#endif
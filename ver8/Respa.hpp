@@ -0,0 +1,58 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _RESPA_HPP
+#define _RESPA_HPP
+
+#include "Octree.hpp"
+
+// Force split of the multiple time stepping (RESPA) integrator. The pair
+// force F is divided with the smooth switch
+//   S(r) = 1 - x^2 (3 - 2x),  x = (r - rin)/(rc - rin) clamped to [0,1],
+// into the near part S F, summed here over the neighbours closer than rc
+// found with the octree, and the far part (1 - S) F, the respa_far kernel.
+// Both use the softened distance, so that the two parts add up to F.
+class Respa
+{
+public:
+  Respa(real_type rc = 0.1f);
+  ~Respa();
+
+  // Compute the near accelerations of all particles, return the number of
+  // pair interactions evaluated
+  double near_forces(ParticleSoA *particles, int n,
+                     real_type G, real_type softeningSquared);
+
+  inline real_type get_cutoff() const {return _rc; }
+  inline real_type get_inner() const {return _rin; }
+
+private:
+  Octree _tree;
+  real_type _rc;		//near field cutoff
+  real_type _rin;		//start of the switch
+
+  int _capacity;
+  real_type *_ax, *_ay, *_az;	//near accelerations in tree order
+
+  void reserve(int n);
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <omp.h>
+
+#include "SpaceCurve.hpp"
+
+static const int bits = 10;		//bits of a cell coordinate
+
+// Hilbert transpose of the cell coordinates X, in place: J. Skilling,
+// "Programming the Hilbert curve", AIP Conf. Proc. 707 (2004) 381
+static inline void axes_to_transpose(unsigned X[3])
+{
+  const unsigned M = 1u << (bits - 1);
+  for (unsigned Q = M; Q > 1; Q >>= 1)
+  {
+    const unsigned P = Q - 1;
+    for (int i = 0; i < 3; ++i)
+    {
+      if(X[i] & Q)
+        X[0] ^= P;
+      else
+      {
+        const unsigned t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+  // Gray encode
+  X[1] ^= X[0];
+  X[2] ^= X[1];
+  unsigned t = 0;
+  for (unsigned Q = M; Q > 1; Q >>= 1)
+    if(X[2] & Q) t ^= Q - 1;
+  for (int i = 0; i < 3; ++i)
+    X[i] ^= t;
+}
+
+// bits of X interleaved from the most significant, x first
+static inline unsigned interleave(const unsigned X[3])
+{
+  unsigned key = 0;
+  for (int b = bits - 1; b >= 0; --b)
+    key = (key << 3) | (((X[0] >> b) & 1u) << 2) | (((X[1] >> b) & 1u) << 1) | ((X[2] >> b) & 1u);
+  return key;
+}
+
+SpaceCurve :: SpaceCurve(CurveKind kind) : _kind(kind)
+{
+}
+
+const int *SpaceCurve :: sort(const ParticleSoA *particles, int n, int nfirst)
+{
+  _key.resize(n);
+  _tkey.resize(n);
+  _perm.resize(n);
+  _tperm.resize(n);
+  const real_type *px = particles->pos_x;
+  const real_type *py = particles->pos_y;
+  const real_type *pz = particles->pos_z;
+
+  real_type xmin = px[0], xmax = px[0];
+  real_type ymin = py[0], ymax = py[0];
+  real_type zmin = pz[0], zmax = pz[0];
+#pragma omp parallel for reduction(min:xmin,ymin,zmin) reduction(max:xmax,ymax,zmax)
+  for (int i = 0; i < n; ++i)
+  {
+    xmin = std::min(xmin, px[i]);
+    xmax = std::max(xmax, px[i]);
+    ymin = std::min(ymin, py[i]);
+    ymax = std::max(ymax, py[i]);
+    zmin = std::min(zmin, pz[i]);
+    zmax = std::max(zmax, pz[i]);
+  }
+  const real_type size = std::max(xmax - xmin, std::max(ymax - ymin, zmax - zmin));
+  const real_type scale = (size > 0.0f) ? (1 << bits) / size : 0.0f;
+  const unsigned cmax = (1u << bits) - 1;
+
+  // the particles after nfirst get the bit above the curve, so that they
+  // stay after the first ones
+  const bool hilbert = (_kind == CURVE_HILBERT);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i)
+  {
+    unsigned X[3];
+    X[0] = std::min(cmax, (unsigned) ((px[i] - xmin) * scale));
+    X[1] = std::min(cmax, (unsigned) ((py[i] - ymin) * scale));
+    X[2] = std::min(cmax, (unsigned) ((pz[i] - zmin) * scale));
+    if(hilbert)
+      axes_to_transpose(X);
+    _key[i] = interleave(X) | ((i >= nfirst) ? 1u << (3 * bits) : 0u);
+    _perm[i] = i;
+  }
+
+  radix_sort(n, 3 * bits + 1);
+  return &_perm[0];
+}
+
+// Stable LSD radix sort of _key, with _perm along. Every thread counts the
+// digits of its static chunk, the offsets go over the digits and then the
+// threads, so that the scatter keeps the order; an even number of passes
+// leaves the result in _key and _perm.
+void SpaceCurve :: radix_sort(int n, int nbits)
+{
+  const int npasses = ((nbits + 7) / 8 + 1) / 2 * 2;
+  _hist.resize(256 * omp_get_max_threads());
+  unsigned *key = &_key[0], *tkey = &_tkey[0];
+  int *perm = &_perm[0], *tperm = &_tperm[0];
+  int *hist = &_hist[0];
+
+  for (int pass = 0; pass < npasses; ++pass)
+  {
+    const int shift = 8 * pass;
+#pragma omp parallel
+    {
+      const int nt = omp_get_num_threads();
+      const int t = omp_get_thread_num();
+      const int begin = (int) ((long) n * t / nt);
+      const int end = (int) ((long) n * (t + 1) / nt);
+      int *h = hist + 256 * t;
+      for (int d = 0; d < 256; ++d)
+        h[d] = 0;
+      for (int i = begin; i < end; ++i)
+        h[(key[i] >> shift) & 255u]++;
+#pragma omp barrier
+#pragma omp single
+      {
+        int sum = 0;
+        for (int d = 0; d < 256; ++d)
+          for (int u = 0; u < nt; ++u)
+          {
+            const int c = hist[256 * u + d];
+            hist[256 * u + d] = sum;
+            sum += c;
+          }
+      }
+      for (int i = begin; i < end; ++i)
+      {
+        const int dst = h[(key[i] >> shift) & 255u]++;
+        tkey[dst] = key[i];
+        tperm[dst] = perm[i];
+      }
+    }
+    std::swap(key, tkey);
+    std::swap(perm, tperm);
+  }
+}
@@ -0,0 +1,60 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SPACECURVE_HPP
+#define _SPACECURVE_HPP
+
+#include <vector>
+
+#include "Particle.hpp"
+
+enum CurveKind
+{
+  CURVE_MORTON,			//Z order, bits of x, y, z interleaved
+  CURVE_HILBERT			//Hilbert curve, no jumps between neighbour cells
+};
+
+// Order of the particles along a space filling curve: the bounding box is
+// cut in 2^10 cells per dimension, every particle gets the 30 bit key of
+// its cell along the curve and the (key, index) pairs are sorted with a
+// parallel LSD radix sort, 8 bits per pass, with per-thread histograms.
+class SpaceCurve
+{
+public:
+  SpaceCurve(CurveKind kind = CURVE_MORTON);
+
+  // Sort the first n particles along the curve, keeping the first nfirst
+  // before the others; return perm, perm[i] the particle going to i
+  const int *sort(const ParticleSoA *particles, int n, int nfirst);
+
+  inline CurveKind get_kind() const {return _kind; }
+
+private:
+  CurveKind _kind;
+
+  std::vector<unsigned> _key, _tkey;	//keys and their copy of the passes
+  std::vector<int> _perm, _tperm;	//particle indices and their copy
+  std::vector<int> _hist;		//256 counts per thread
+
+  void radix_sort(int n, int bits);
+};
+
+#endif
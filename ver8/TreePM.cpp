@@ -0,0 +1,182 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <mm_malloc.h>
+
+#include "TreePM.hpp"
+
+static const int alignment = 32;
+static const int ntable = 4096;		//intervals of the short range table
+
+// periodic distance of two coordinates in the unit box
+static inline real_type periodic(real_type d)
+{
+  d = std::abs(d);
+  return std::min(d, 1.0f - d);
+}
+
+TreePM :: TreePM(int ngrid, real_type rs) : _pm(ngrid), _tree(16),
+                                            _capacity(0), _ax(NULL), _ay(NULL), _az(NULL)
+{
+  // default split: 1.25 mesh cells
+  _rs = (rs > 0.0f) ? rs : 1.25f / _pm.get_ngrid();
+  _rcut = 4.5f * _rs;
+  _pm.set_split(_rs);
+
+  // h(r) of the long range part on a uniform grid in r^2 up to rcut, with
+  // a guard entry for the interpolation at the end; h(0) is the limit
+  // 4 alpha^3 / 3 sqrt(pi), alpha = 1 / 2rs
+  const double alpha = 0.5 / _rs;
+  _scale = ntable / (_rcut * _rcut);
+  _table.resize(ntable + 2);
+  _table[0] = 4. * alpha * alpha * alpha / (3. * sqrt(M_PI));
+  for (int i = 1; i < ntable + 2; ++i)
+  {
+    const double r = sqrt(i / (double) _scale);
+    _table[i] = (erf(alpha * r) - 2. * alpha * r / sqrt(M_PI) * exp(-alpha * alpha * r * r))
+              / (r * r * r);
+  }
+}
+
+TreePM :: ~TreePM()
+{
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+}
+
+void TreePM :: reserve(int n)
+{
+  if(n <= _capacity) return;
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+  _ax = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _ay = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _az = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _capacity = n;
+}
+
+double TreePM :: compute_forces(ParticleSoA *particles, int n,
+                                real_type G, real_type softeningSquared)
+{
+  reserve(n);
+
+  // long range part straight into the particle accelerations
+  _pm.compute_forces(particles, n, G);
+
+  _tree.build(particles, n);
+  const std::vector<OctreeNode> &nodes = _tree._nodes;
+  const real_type *x = _tree.x;
+  const real_type *y = _tree.y;
+  const real_type *z = _tree.z;
+  const real_type *m = _tree.m;
+  const int nleaves = _tree.get_nleaves();
+
+  const real_type rcut2 = _rcut * _rcut;
+  const real_type *table = &_table[0];
+  const real_type scale = _scale;
+
+  double ninter = 0.;
+#pragma omp parallel reduction(+:ninter)
+  {
+    std::vector<real_type> lx, ly, lz, lm;
+    std::vector<int> stack;
+
+#pragma omp for schedule(dynamic,4)
+    for (int l = 0; l < nleaves; ++l)
+    {
+      const OctreeNode &leaf = nodes[_tree._leaves[l]];
+      lx.clear(); ly.clear(); lz.clear(); lm.clear();
+
+      // neighbour leaves: cells closer than rcut to the leaf cube
+      stack.clear();
+      stack.push_back(0);
+      while(!stack.empty())
+      {
+        const OctreeNode &cell = nodes[stack.back()];
+        stack.pop_back();
+
+        real_type dx = std::max(periodic(cell.cx - leaf.cx) - cell.half - leaf.half, 0.0f);
+        real_type dy = std::max(periodic(cell.cy - leaf.cy) - cell.half - leaf.half, 0.0f);
+        real_type dz = std::max(periodic(cell.cz - leaf.cz) - cell.half - leaf.half, 0.0f);
+        if(dx*dx + dy*dy + dz*dz > rcut2) continue;
+
+        if(cell.child < 0)
+        {
+          lx.insert(lx.end(), x + cell.begin, x + cell.end);
+          ly.insert(ly.end(), y + cell.begin, y + cell.end);
+          lz.insert(lz.end(), z + cell.begin, z + cell.end);
+          lm.insert(lm.end(), m + cell.begin, m + cell.end);
+        }
+        else
+        {
+          for (int c = cell.child; c < cell.child + cell.nchild; ++c)
+            stack.push_back(c);
+        }
+      }
+
+      const int nlist = (int) lx.size();
+      const real_type *jx = lx.data();
+      const real_type *jy = ly.data();
+      const real_type *jz = lz.data();
+      const real_type *jm = lm.data();
+      for (int i = leaf.begin; i < leaf.end; ++i)
+      {
+        const real_type xi = x[i], yi = y[i], zi = z[i];
+        real_type ax_i = 0.0f, ay_i = 0.0f, az_i = 0.0f;
+#pragma omp simd reduction(+:ax_i,ay_i,az_i)
+        for (int j = 0; j < nlist; ++j)
+        {
+          real_type dx = jx[j] - xi;
+          real_type dy = jy[j] - yi;
+          real_type dz = jz[j] - zi;
+          dx -= rintf(dx);						//minimum image
+          dy -= rintf(dy);
+          dz -= rintf(dz);
+
+          // the split is in the true distance, the mesh is not softened
+          real_type r2 = dx*dx + dy*dy + dz*dz;
+          real_type distanceInv = 1.0f / sqrtf(r2 + softeningSquared);
+
+          real_type u = ((r2 < rcut2) ? r2 : rcut2) * scale;
+          int k = (int) u;
+          real_type t = u - (real_type) k;
+          real_type h = table[k] + t * (table[k + 1] - table[k]);
+          real_type f = (r2 < rcut2) ?
+                        G * jm[j] * (distanceInv * distanceInv * distanceInv - h) : 0.0f;
+          ax_i += dx * f;
+          ay_i += dy * f;
+          az_i += dz * f;
+        }
+        _ax[i] = ax_i;
+        _ay[i] = ay_i;
+        _az[i] = az_i;
+      }
+      ninter += double(leaf.end - leaf.begin) * double(nlist);
+    }
+  }
+
+  _tree.scatter_acc(particles, _ax, _ay, _az, true);
+  return ninter;
+}
@@ -0,0 +1,65 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TREEPM_HPP
+#define _TREEPM_HPP
+
+#include <vector>
+
+#include "Octree.hpp"
+#include "ParticleMesh.hpp"
+
+// TreePM force split in the periodic unit box. The mesh carries the long
+// range force, filtered by exp(-k^2 rs^2), without softening; the short
+// range force is the softened pair force minus that long range part,
+//   G m r [1/(r^2+eps^2)^(3/2) - h(r)],
+//   h(r) = [1 - erfc(r/2rs) - r/(rs sqrt(pi)) exp(-r^2/4rs^2)] / r^3,
+// summed over the neighbours closer than rcut = 4.5 rs, found with the
+// octree, with h interpolated from a table in r^2 as in the Ewald sum.
+class TreePM
+{
+public:
+  TreePM(int ngrid = 64, real_type rs = 0.0f);
+  ~TreePM();
+
+  // Compute the accelerations of all particles, return the number of
+  // short range pair interactions evaluated
+  double compute_forces(ParticleSoA *particles, int n,
+                        real_type G, real_type softeningSquared);
+
+  inline int get_ngrid() const {return _pm.get_ngrid(); }
+  inline real_type get_split() const {return _rs; }
+  inline real_type get_cutoff() const {return _rcut; }
+
+private:
+  ParticleMesh _pm;
+  Octree _tree;
+  real_type _rs;		//split radius
+  real_type _rcut;		//short range cutoff
+  std::vector<real_type> _table;	//h at r^2 = i / _scale, for r^2 up to rcut^2
+  real_type _scale;
+
+  int _capacity;
+  real_type *_ax, *_ay, *_az;	//short range accelerations in tree order
+
+  void reserve(int n);
+};
+
+#endif
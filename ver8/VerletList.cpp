@@ -0,0 +1,185 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <mm_malloc.h>
+#include <omp.h>
+
+#include "VerletList.hpp"
+#include "Kernels.hpp"
+
+static const int alignment = 32;
+
+VerletList :: VerletList(real_type rc, real_type skin) : _cells(rc + skin), _rc(rc), _skin(skin),
+                                                         _nbuilds(0), _stale(false), _capacity(0),
+                                                         _x0(NULL), _y0(NULL), _z0(NULL),
+                                                         _ax(NULL), _ay(NULL), _az(NULL)
+{
+}
+
+VerletList :: ~VerletList()
+{
+  _mm_free(_x0);
+  _mm_free(_y0);
+  _mm_free(_z0);
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+}
+
+void VerletList :: reserve(int n)
+{
+  if(n <= _capacity) return;
+  _mm_free(_x0);
+  _mm_free(_y0);
+  _mm_free(_z0);
+  _mm_free(_ax);
+  _mm_free(_ay);
+  _mm_free(_az);
+  _x0 = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _y0 = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _z0 = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _ax = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _ay = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _az = (real_type*) _mm_malloc(n*sizeof(real_type),alignment);
+  _capacity = n;
+}
+
+// Has any particle moved more than skin/2 since the last build?
+bool VerletList :: moved(const ParticleSoA *particles, int n) const
+{
+  real_type d2max = 0.0f;
+#pragma omp parallel for reduction(max:d2max)
+  for (int i = 0; i < n; ++i)
+  {
+    const real_type dx = particles->pos_x[i] - _x0[i];
+    const real_type dy = particles->pos_y[i] - _y0[i];
+    const real_type dz = particles->pos_z[i] - _z0[i];
+    d2max = std::max(d2max, dx*dx + dy*dy + dz*dz);
+  }
+  return d2max > 0.25f * _skin * _skin;
+}
+
+// Every thread appends the lists of its cells to a buffer of its own and
+// records where each one starts; the lists are copied in place once the
+// counts are known
+void VerletList :: build(const ParticleSoA *particles, int n)
+{
+  reserve(n);
+  _cells.build(particles, n);
+
+  const real_type *x = _cells.x;
+  const real_type *y = _cells.y;
+  const real_type *z = _cells.z;
+  const real_type rl2 = (_rc + _skin) * (_rc + _skin);
+  const int ncells = _cells.get_ncells();
+
+  _offset.assign(n + 1, 0);
+  _where.resize(n);
+  _buffers.resize(omp_get_max_threads());
+
+#pragma omp parallel
+  {
+    std::vector<int> &buffer = _buffers[omp_get_thread_num()];
+    buffer.clear();
+
+#pragma omp for schedule(dynamic,16)
+    for (int c = 0; c < ncells; ++c)
+    {
+      if(_cells._start[c] == _cells._start[c + 1]) continue;
+      int begin[9], end[9];
+      const int nrows = _cells.neighbour_rows(c, begin, end);
+
+      for (int i = _cells._start[c]; i < _cells._start[c + 1]; ++i)
+      {
+        const int first = (int) buffer.size();
+        for (int r = 0; r < nrows; ++r)
+          for (int j = begin[r]; j < end[r]; ++j)
+          {
+            const real_type dx = x[j] - x[i];
+            const real_type dy = y[j] - y[i];
+            const real_type dz = z[j] - z[i];
+            if(j != i && dx*dx + dy*dy + dz*dz < rl2)
+              buffer.push_back(j);
+          }
+        _where[i] = std::make_pair(omp_get_thread_num(), first);
+        _offset[i + 1] = (int) buffer.size() - first;
+      }
+    }
+  }
+
+  for (int i = 0; i < n; ++i)
+    _offset[i + 1] += _offset[i];
+  _neigh.resize(_offset[n]);
+
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    // data() + offset: a list may be empty at the end of an empty buffer
+    const int *list = _buffers[_where[i].first].data() + _where[i].second;
+    std::copy(list, list + _offset[i + 1] - _offset[i], _neigh.data() + _offset[i]);
+  }
+
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+  {
+    _x0[i] = particles->pos_x[i];
+    _y0[i] = particles->pos_y[i];
+    _z0[i] = particles->pos_z[i];
+  }
+  _nbuilds++;
+}
+
+double VerletList :: compute_forces(ParticleSoA *particles, int n, const KernelTable *kernels,
+                                    real_type G, real_type softeningSquared)
+{
+  if(_nbuilds == 0 || _stale || n != _cells._n || moved(particles, n))
+  {
+    build(particles, n);
+    _stale = false;
+  }
+  else
+  {
+    // the sorted copies follow the particles
+#pragma omp parallel for
+    for (int k = 0; k < n; ++k)
+    {
+      const int i = _cells.index[k];
+      _cells.x[k] = particles->pos_x[i];
+      _cells.y[k] = particles->pos_y[i];
+      _cells.z[k] = particles->pos_z[i];
+    }
+  }
+
+  const double ninter = kernels->neighbours(_cells.x, _cells.y, _cells.z, _cells.m, n,
+                                            _offset.data(), _neigh.data(),
+                                            G, softeningSquared, _rc, _ax, _ay, _az);
+
+#pragma omp parallel for
+  for (int k = 0; k < n; ++k)
+  {
+    const int i = _cells.index[k];
+    particles->acc_x[i] = _ax[k];
+    particles->acc_y[i] = _ay[k];
+    particles->acc_z[i] = _az[k];
+  }
+  return ninter;
+}
@@ -0,0 +1,77 @@
+/*
+    This file is part of the example codes which have been used
+    for the "Code Optmization Workshop".
+
+    Copyright (C) 2016  Fabio Baruffa <fbaru-dev@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _VERLETLIST_HPP
+#define _VERLETLIST_HPP
+
+#include <utility>
+#include <vector>
+
+#include "CellList.hpp"
+
+struct KernelTable;
+
+// Verlet neighbour lists for a force cut off at rc: every particle keeps
+// the list of the particles closer than rc + skin, found with linked cells
+// of that side, and the lists are rebuilt only once some particle has moved
+// more than skin/2 since the last build. The lists are in CSR form over the
+// cell sorted copies of the particles, so that the neighbours of a particle
+// are close to it in memory; the sorted positions are refreshed every step.
+class VerletList
+{
+public:
+  VerletList(real_type rc = 0.1f, real_type skin = 0.02f);
+  ~VerletList();
+
+  // Compute the accelerations of all particles with the neighbours kernel,
+  // rebuilding the lists if needed; return the number of pairs evaluated
+  double compute_forces(ParticleSoA *particles, int n, const KernelTable *kernels,
+                        real_type G, real_type softeningSquared);
+
+  inline real_type get_cutoff() const {return _rc; }
+  inline real_type get_skin() const {return _skin; }
+  inline int get_nbuilds() const {return _nbuilds; }
+  
+  // the particles have been permuted: rebuild at the next call
+  inline void invalidate() { _stale = true; }
+
+private:
+  CellList _cells;
+  real_type _rc;		//cutoff radius
+  real_type _skin;		//extra radius of the lists
+  int _nbuilds;			//lists built so far
+  bool _stale;			//lists to rebuild whether the particles moved or not
+
+  std::vector<int> _offset;	//neighbours of sorted particle i: _neigh[_offset[i].._offset[i+1])
+  std::vector<int> _neigh;	//sorted indices of the neighbours
+  std::vector< std::vector<int> > _buffers;		//lists written by every thread
+  std::vector< std::pair<int,int> > _where;		//thread and start of every list
+
+  int _capacity;
+  real_type *_x0, *_y0, *_z0;	//positions at the last build
+  real_type *_ax, *_ay, *_az;	//accelerations in sorted order
+
+  void reserve(int n);
+  bool moved(const ParticleSoA *particles, int n) const;
+  void build(const ParticleSoA *particles, int n);
+};
+
+#endif
@@ -19,9 +19,53 @@
  */
 
 #include <iostream>
+#include <string>
 
 #include "GSimulation.hpp"
 
+static void usage(const char *exe)
+{
+  std::cout << "Usage: " << exe << " [<# of particles> [<# of integration steps> [options]]]" << std::endl;
+  std::cout << "Options:" << std::endl;
+  std::cout << "  -mode <direct|symmetric|bh|fmm|pm|treepm|cutoff|verlet|ewald>" << std::endl;
+  std::cout << "                      force computation (default: direct)" << std::endl;
+  std::cout << "  -kernel <pragma|intrin>" << std::endl;
+  std::cout << "                      inner loop of the direct sum (default: pragma)" << std::endl;
+  std::cout << "  -itile <2|4|8|16>    i particles per register tile (default: tuned)" << std::endl;
+  std::cout << "  -jtile <n>          j particles per cache tile (default: tuned)" << std::endl;
+  std::cout << "  -dt <value>         time step (default: 0.1)" << std::endl;
+  std::cout << "  -integrator <euler|leapfrog|hermite|block|respa>" << std::endl;
+  std::cout << "                      time integration (default: euler)" << std::endl;
+  std::cout << "  -eta <value>        accuracy of the block time steps (default: 0.02)" << std::endl;
+  std::cout << "  -tracers <n>        add n massless tracer particles" << std::endl;
+  std::cout << "  -nsub <K>           RESPA near steps per far step of dt (default: 4)" << std::endl;
+  std::cout << "  -rc <value>         cutoff of the RESPA near field and of the cutoff modes (default: 0.1)" << std::endl;
+  std::cout << "  -skin <value>       extra radius of the Verlet lists (default: 0.02)" << std::endl;
+  std::cout << "  -adaptive <eta>     global time step eta sqrt(eps/|a|max), starting from dt;" << std::endl;
+  std::cout << "                      runs for the simulated time of nsteps fixed steps" << std::endl;
+  std::cout << "  -tend <value>       simulated time of an adaptive run" << std::endl;
+  std::cout << "  -reject <tol>       retake adaptive steps with a relative energy error above tol" << std::endl;
+  std::cout << "  -fused              fuse the direct sum with the update (pragma kernel)" << std::endl;
+  std::cout << "  -lowmem             no acceleration arrays: the direct sum kicks the velocities" << std::endl;
+  std::cout << "                      (pragma kernel, Euler)" << std::endl;
+  std::cout << "  -packed             stream the j particles of the direct sum as {x, y, z, G m}" << std::endl;
+  std::cout << "  -isa <sse42|avx2|avx512>" << std::endl;
+  std::cout << "                      instruction set of the kernels (default: best supported)" << std::endl;
+  std::cout << "  -theta <value>      Barnes-Hut opening angle (default: 0.5)" << std::endl;
+  std::cout << "  -order <p>          FMM expansion order (default: 4)" << std::endl;
+  std::cout << "  -grid <n>           PM grid points per dimension, a power of two (default: 64)" << std::endl;
+  std::cout << "  -rs <value>         TreePM split radius (default: 1.25 grid cells)" << std::endl;
+  std::cout << "  -alpha <value>      Ewald split parameter, in 1/box (default: 6)" << std::endl;
+  std::cout << "  -kmax <n>           Ewald largest k-vector, in units of 2 pi (default: 7)" << std::endl;
+  std::cout << "  -layout             time the direct sum on AoS, SoA and AoSoA particles instead" << std::endl;
+  std::cout << "  -reorder <K>        sort the particles along a space filling curve every K steps" << std::endl;
+  std::cout << "  -curve <hilbert|morton>" << std::endl;
+  std::cout << "                      curve of -reorder (default: hilbert)" << std::endl;
+  std::cout << "  -out <file>         write the final particles, in their initial order" << std::endl;
+  std::cout << "  -arena <thp|hugetlb> allocate the particle arrays in one mapping on huge pages" << std::endl;
+  std::cout << "  -check              compare with the direct sum on sample steps (Ewald if periodic)" << std::endl;
+}
+
 int main(int argc, char** argv) 
 {
   int N;			//number of particles
@@ -29,17 +73,201 @@ int main(int argc, char** argv)
   
   GSimulation sim;
     
+  if(argc>1 && argv[1][0] == '-')
+  {
+    usage(argv[0]);
+    return 0;
+  }
+  
   if(argc>1)
   {
     N=atoi(argv[1]);
     sim.set_number_of_particles(N);  
-    if(argc==3) 
+    if(argc>2) 
     {
       nstep=atoi(argv[2]);
       sim.set_number_of_steps(nstep);  
     }
   }
   
+  for(int a=3; a<argc; ++a)
+  {
+    std::string opt = argv[a];
+    std::string val = (a+1 < argc) ? argv[a+1] : "";
+    
+    if(opt == "-mode")
+    {
+      if(val == "direct")  sim.set_force_mode(FORCE_DIRECT);
+      else if(val == "symmetric") sim.set_force_mode(FORCE_SYMMETRIC);
+      else if(val == "bh") sim.set_force_mode(FORCE_BARNES_HUT);
+      else if(val == "fmm") sim.set_force_mode(FORCE_FMM);
+      else if(val == "pm") sim.set_force_mode(FORCE_PM);
+      else if(val == "treepm") sim.set_force_mode(FORCE_TREEPM);
+      else if(val == "cutoff") sim.set_force_mode(FORCE_CUTOFF);
+      else if(val == "verlet") sim.set_force_mode(FORCE_VERLET);
+      else if(val == "ewald") sim.set_force_mode(FORCE_EWALD);
+      else { usage(argv[0]); return 1; }
+      ++a;
+    }
+    else if(opt == "-kernel")
+    {
+      if(val == "pragma") sim.set_kernel(KERNEL_PRAGMA);
+      else if(val == "intrin") sim.set_kernel(KERNEL_INTRIN);
+      else { usage(argv[0]); return 1; }
+      ++a;
+    }
+    else if(opt == "-itile")
+    {
+      if(val != "2" && val != "4" && val != "8" && val != "16") { usage(argv[0]); return 1; }
+      sim.set_itile(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-jtile" && !val.empty())
+    {
+      sim.set_jtile(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-dt" && !val.empty())
+    {
+      sim.set_time_step(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-integrator")
+    {
+      if(val == "euler") sim.set_integrator(INTEGRATOR_EULER);
+      else if(val == "leapfrog") sim.set_integrator(INTEGRATOR_LEAPFROG);
+      else if(val == "hermite") sim.set_integrator(INTEGRATOR_HERMITE);
+      else if(val == "block") sim.set_integrator(INTEGRATOR_BLOCK);
+      else if(val == "respa") sim.set_integrator(INTEGRATOR_RESPA);
+      else { usage(argv[0]); return 1; }
+      ++a;
+    }
+    else if(opt == "-eta" && !val.empty())
+    {
+      sim.set_eta(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-tracers" && !val.empty())
+    {
+      sim.set_ntracers(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-nsub" && !val.empty())
+    {
+      sim.set_nsub(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-rc" && !val.empty())
+    {
+      sim.set_rcut(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-skin" && !val.empty())
+    {
+      sim.set_skin(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-adaptive" && !val.empty())
+    {
+      sim.set_adaptive(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-tend" && !val.empty())
+    {
+      sim.set_tend(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-reject" && !val.empty())
+    {
+      sim.set_reject(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-fused")
+    {
+      sim.set_fused(true);
+    }
+    else if(opt == "-lowmem")
+    {
+      sim.set_lowmem(true);
+    }
+    else if(opt == "-packed")
+    {
+      sim.set_packed(true);
+    }
+    else if(opt == "-isa")
+    {
+      if(val != "sse42" && val != "avx2" && val != "avx512") { usage(argv[0]); return 1; }
+      sim.set_isa(val);
+      ++a;
+    }
+    else if(opt == "-theta" && !val.empty())
+    {
+      sim.set_theta(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-order" && !val.empty())
+    {
+      sim.set_order(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-grid" && !val.empty())
+    {
+      sim.set_ngrid(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-rs" && !val.empty())
+    {
+      sim.set_rsplit(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-alpha" && !val.empty())
+    {
+      sim.set_alpha(atof(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-kmax" && !val.empty())
+    {
+      sim.set_kmax(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-reorder" && !val.empty())
+    {
+      sim.set_reorder(atoi(val.c_str()));
+      ++a;
+    }
+    else if(opt == "-curve")
+    {
+      if(val == "hilbert") sim.set_curve(CURVE_HILBERT);
+      else if(val == "morton") sim.set_curve(CURVE_MORTON);
+      else { usage(argv[0]); return 1; }
+      ++a;
+    }
+    else if(opt == "-out" && !val.empty())
+    {
+      sim.set_output(val);
+      ++a;
+    }
+    else if(opt == "-arena")
+    {
+      if(val != "thp" && val != "hugetlb") { usage(argv[0]); return 1; }
+      sim.set_pages(val);
+      ++a;
+    }
+    else if(opt == "-layout")
+    {
+      sim.set_layout(true);
+    }
+    else if(opt == "-check")
+    {
+      sim.set_check(true);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  
   sim.start();
 
   return 0;
@@ -18,4 +18,9 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-typedef float real_type;
\ No newline at end of file
+typedef float real_type;
+
+// __assume_aligned is a builtin of the Intel compiler only
+#ifndef __INTEL_COMPILER
+#define __assume_aligned(p,a)
+#endif